@@ -0,0 +1,234 @@
+#ifndef OPENGL_5_AXIS_BENCHMARK_H
+#define OPENGL_5_AXIS_BENCHMARK_H
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <cstring>
+
+// Minimal benchmark harness. Each case runs with a doubling iteration count until it has
+// accumulated BENCHMARK_MIN_TIME seconds, and results are written in the same JSON layout
+// Google Benchmark uses (--benchmark_out=<file>), so the usual compare tooling applies.
+// As there, only the keepRunning() loop is timed; setup before it is not.
+
+const double BENCHMARK_MIN_TIME = 0.5;
+
+class BenchmarkState {
+private:
+    long maxIterations;
+    long iteration;
+    bool stopped;
+    std::chrono::steady_clock::time_point startedAt;
+    std::chrono::steady_clock::time_point stoppedAt;
+    std::clock_t startedCpuAt;
+    std::clock_t stoppedCpuAt;
+    std::chrono::steady_clock::time_point pausedAt;
+    std::clock_t pausedCpuAt;
+
+public:
+    const long range;
+    long itemsProcessed;
+    double pausedSeconds;
+    double pausedCpuSeconds;
+
+    BenchmarkState(long range, long iterations)
+            : maxIterations(iterations), iteration(0), stopped(false), startedCpuAt(0), stoppedCpuAt(0),
+              pausedCpuAt(0), range(range), itemsProcessed(0), pausedSeconds(0.0), pausedCpuSeconds(0.0) {
+    }
+
+    //Accessors
+    double getRealSeconds() const {
+        return std::chrono::duration<double>(this->stoppedAt - this->startedAt).count() - this->pausedSeconds;
+    }
+
+    double getCpuSeconds() const {
+        return double(this->stoppedCpuAt - this->startedCpuAt) / CLOCKS_PER_SEC - this->pausedCpuSeconds;
+    }
+
+    //Functions
+    // The clocks start on the first call and stop on the call that ends the loop
+    bool keepRunning() {
+        if (this->iteration == 0) {
+            this->startedAt = std::chrono::steady_clock::now();
+            this->startedCpuAt = std::clock();
+        }
+
+        if (this->iteration++ < this->maxIterations)
+            return true;
+
+        this->stop();
+        return false;
+    }
+
+    // Stops the clocks if the loop was left early (or never entered)
+    void stop() {
+        if (this->stopped)
+            return;
+
+        this->stoppedAt = std::chrono::steady_clock::now();
+        this->stoppedCpuAt = std::clock();
+        if (this->iteration == 0) {
+            this->startedAt = this->stoppedAt;
+            this->startedCpuAt = this->stoppedCpuAt;
+        }
+        this->stopped = true;
+    }
+
+    // Excludes setup inside the loop (e.g. resetting state) from the measurement
+    void pauseTiming() {
+        this->pausedAt = std::chrono::steady_clock::now();
+        this->pausedCpuAt = std::clock();
+    }
+
+    void resumeTiming() {
+        this->pausedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - this->pausedAt).count();
+        this->pausedCpuSeconds += double(std::clock() - this->pausedCpuAt) / CLOCKS_PER_SEC;
+    }
+};
+
+// Keeps the compiler from discarding a result that is otherwise unused
+template<typename T>
+static void doNotOptimize(T const &value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T *sink;
+    sink = &value;
+#endif
+}
+
+struct BenchmarkCase {
+    std::string name;
+    std::function<void(BenchmarkState &)> function;
+    std::vector<long> ranges;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    long iterations;
+    double realTime;
+    double cpuTime;
+    double itemsPerSecond;
+};
+
+static std::vector<BenchmarkCase> &benchmarkRegistry() {
+    static std::vector<BenchmarkCase> registry;
+    return registry;
+}
+
+static void registerBenchmark(const std::string &name, std::function<void(BenchmarkState &)> function,
+                              std::vector<long> ranges = {}) {
+    benchmarkRegistry().push_back({name, std::move(function), std::move(ranges)});
+}
+
+static BenchmarkResult runBenchmark(const std::string &name, const std::function<void(BenchmarkState &)> &function,
+                                    long range) {
+    long iterations = 1;
+
+    while (true) {
+        BenchmarkState state(range, iterations);
+
+        function(state);
+        state.stop();
+
+        double real = state.getRealSeconds();
+        double cpu = state.getCpuSeconds();
+
+        if (real >= BENCHMARK_MIN_TIME || iterations >= (1L << 30)) {
+            BenchmarkResult result{};
+            result.name = name;
+            result.iterations = iterations;
+            result.realTime = real / double(iterations) * 1e6;
+            result.cpuTime = cpu / double(iterations) * 1e6;
+            result.itemsPerSecond = state.itemsProcessed > 0 ? double(state.itemsProcessed) / real : 0.0;
+            return result;
+        }
+
+        iterations *= 2;
+    }
+}
+
+static void writeBenchmarkJson(const std::string &filename, const std::vector<BenchmarkResult> &results) {
+    std::ofstream out(filename);
+
+    if (!out.is_open()) {
+        std::cout << "ERROR::BENCHMARK::COULD_NOT_OPEN_FILE: " << filename << "\n";
+        return;
+    }
+
+    out << "{\n  \"context\": {\n    \"executable\": \"benchmarks\",\n    \"library_build_type\": \""
+#ifdef NDEBUG
+        << "release"
+#else
+        << "debug"
+#endif
+        << "\"\n  },\n  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult &result = results[i];
+
+        out << "    {\n"
+            << "      \"name\": \"" << result.name << "\",\n"
+            << "      \"run_name\": \"" << result.name << "\",\n"
+            << "      \"run_type\": \"iteration\",\n"
+            << "      \"iterations\": " << result.iterations << ",\n"
+            << "      \"real_time\": " << result.realTime << ",\n"
+            << "      \"cpu_time\": " << result.cpuTime << ",\n"
+            << "      \"time_unit\": \"us\"";
+
+        if (result.itemsPerSecond > 0)
+            out << ",\n      \"items_per_second\": " << result.itemsPerSecond;
+
+        out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n}\n";
+}
+
+// Accepts --benchmark_filter=<substring> and --benchmark_out=<file.json>
+static int runRegisteredBenchmarks(int argc, char **argv) {
+    std::string filter;
+    std::string outFile;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--benchmark_filter=", 19) == 0)
+            filter = argv[i] + 19;
+        else if (strncmp(argv[i], "--benchmark_out=", 16) == 0)
+            outFile = argv[i] + 16;
+        else
+            std::cout << "Unknown option " << argv[i] << std::endl;
+    }
+
+    std::vector<BenchmarkResult> results;
+
+    for (auto &benchmark : benchmarkRegistry()) {
+        std::vector<long> ranges = benchmark.ranges.empty() ? std::vector<long>{0} : benchmark.ranges;
+
+        for (long range : ranges) {
+            std::string name = benchmark.ranges.empty() ? benchmark.name
+                                                        : benchmark.name + "/" + std::to_string(range);
+
+            if (!filter.empty() && name.find(filter) == std::string::npos)
+                continue;
+
+            BenchmarkResult result = runBenchmark(name, benchmark.function, range);
+            results.push_back(result);
+
+            std::cout << name << "\t" << result.realTime << " us\t" << result.cpuTime << " us cpu\t"
+                      << result.iterations << " iterations" << std::endl;
+        }
+    }
+
+    if (!outFile.empty())
+        writeBenchmarkJson(outFile, results);
+
+    return 0;
+}
+
+#endif //OPENGL_5_AXIS_BENCHMARK_H
@@ -0,0 +1,332 @@
+// Per-stage benchmarks for the contact pipeline.
+//
+// Run from the repository root (shaders are loaded by relative path). The window is hidden,
+// so on a headless host this works under Mesa llvmpipe, e.g.
+//     LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./benchmarks --benchmark_out=bench.json
+
+#include "../game.h"
+#include "benchmark.h"
+
+#include <filesystem>
+#include <random>
+
+static CutterLod gridLod(long divisions) {
+    return CutterLod{-8, 0, divisions, 0, divisions};
+}
+
+static const CutterProfile &torusProfile() {
+    static CutterProfile profile(Cutter::torus());
+    return profile;
+}
+
+static std::string writeTorusObj(long divisions) {
+    std::string filename = (std::filesystem::temp_directory_path() /
+                            ("benchmark_torus_" + std::to_string(divisions) + ".obj")).string();
+    std::ofstream out(filename);
+
+    std::vector<Vertex> torus = generateCutter(torusProfile(), gridLod(divisions));
+
+    for (auto &vertex : torus)
+        out << "v " << vertex.position.x << " " << vertex.position.y << " " << vertex.position.z << "\n";
+    out << "vt 0 1\nvn 1 1 1\n";
+    for (size_t i = 0; i + 2 < torus.size(); i += 3)
+        out << "f " << i + 1 << "/1/1 " << i + 2 << "/1/1 " << i + 3 << "/1/1\n";
+
+    return filename;
+}
+
+static std::string writeTorusStl(long divisions) {
+    std::string filename = (std::filesystem::temp_directory_path() /
+                            ("benchmark_torus_" + std::to_string(divisions) + ".stl")).string();
+
+    std::vector<Vertex> torus = generateCutter(torusProfile(), gridLod(divisions));
+    saveStlFile(filename.c_str(), torus.data(), nullptr, torus.size());
+
+    return filename;
+}
+
+// side * side bicubic patches of 10 x 10 units with a wavy top, like a part exported patch by patch
+static std::vector<NurbsPatch> nurbsPatchGrid(long side) {
+    std::vector<NurbsPatch> patches;
+
+    for (long pu = 0; pu < side; pu++) {
+        for (long pv = 0; pv < side; pv++) {
+            NurbsPatch patch{3, 3, 4, 4, {0, 0, 0, 0, 1, 1, 1, 1}, {0, 0, 0, 0, 1, 1, 1, 1}, {}};
+
+            for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) {
+                    float x = 10.f * (float(pu) + float(i) / 3.f), y = 10.f * (float(pv) + float(j) / 3.f);
+                    patch.controlPoints.emplace_back(x, y, 5.f * std::sin(0.05f * x) * std::cos(0.05f * y), 1.f);
+                }
+            }
+
+            patches.push_back(std::move(patch));
+        }
+    }
+
+    return patches;
+}
+
+int main(int argc, char **argv) {
+    Game game("benchmarks",
+              480, 480,
+              4, 4,
+              false, false);
+
+    registerBenchmark("generateTorus", [](BenchmarkState &state) {
+        CutterLod lod = gridLod(state.range);
+        while (state.keepRunning()) {
+            std::vector<Vertex> torus = generateCutter(torusProfile(), lod);
+            state.itemsProcessed += long(torus.size());
+        }
+    }, {64, 150, 256, 512, 1024});
+
+    registerBenchmark("cutterFootprint", [](BenchmarkState &state) {
+        CutterProfile profile(Cutter::bullNose(10.f, 2.f, 20.f));
+        size_t nrOfPixels = size_t(state.range) * size_t(state.range);
+        std::vector<GLfloat> distance(nrOfPixels);
+        std::vector<GLubyte> mask(nrOfPixels);
+
+        while (state.keepRunning()) {
+            evaluateCutterFootprint(profile, glm::vec2(0.f), 40.f, -13.5f, 13.5f, -13.5f, 13.5f,
+                                    int(state.range), int(state.range), distance.data(), mask.data());
+            doNotOptimize(distance.data());
+            state.itemsProcessed += long(nrOfPixels);
+        }
+    }, {256, 480, 1024});
+
+    registerBenchmark("sweptFootprint", [](BenchmarkState &state) {
+        CutterProfile profile(Cutter::bullNose(10.f, 2.f, 20.f));
+        size_t nrOfPixels = size_t(state.range) * size_t(state.range);
+        std::vector<GLfloat> distance(nrOfPixels);
+        std::vector<GLubyte> mask(nrOfPixels);
+
+        while (state.keepRunning()) {
+            evaluateSweptFootprint(profile, glm::vec2(-6.f, -2.f), glm::vec2(6.f, 3.f), 40.f, 40.5f,
+                                   -13.5f, 13.5f, -13.5f, 13.5f, int(state.range), int(state.range),
+                                   distance.data(), mask.data());
+            doNotOptimize(distance.data());
+            state.itemsProcessed += long(nrOfPixels);
+        }
+    }, {256, 480, 1024});
+
+    registerBenchmark("zmapCut", [](BenchmarkState &state) {
+        //Zig-zag raster of state.range passes over a 1024x1024 block
+        std::vector<glm::vec3> toolpath;
+        for (long pass = 0; pass < state.range; pass++) {
+            float y = 102.4f * (float(pass) + 0.5f) / float(state.range);
+            toolpath.emplace_back(pass % 2 ? 102.4f : 0.f, y, -1.f);
+            toolpath.emplace_back(pass % 2 ? 0.f : 102.4f, y, -1.f);
+        }
+
+        while (state.keepRunning()) {
+            ZMap stock(glm::vec2(0.f), 0.1f, 1024, 1024, 0.f);
+            std::vector<glm::vec3> poses = ZMap::interpolatePath(toolpath, stock.getCellSize());
+            stock.cut(Cutter::bullNose(10.f, 2.f, 20.f), poses);
+            doNotOptimize(stock.getHeights());
+            state.itemsProcessed += long(poses.size());
+        }
+    }, {16, 64, 256});
+
+    registerBenchmark("generateTriangles", [](BenchmarkState &state) {
+        while (state.keepRunning()) {
+            std::vector<Meshlet> tiles;
+            std::vector<Vertex> bezier = generateTriangles(&tiles);
+            state.itemsProcessed += long(bezier.size());
+        }
+    });
+
+    registerBenchmark("generateNurbsMesh", [](BenchmarkState &state) {
+        std::vector<NurbsPatch> patches = nurbsPatchGrid(state.range);
+        while (state.keepRunning()) {
+            std::vector<Vertex> vertices;
+            std::vector<GLuint> indices;
+            std::vector<Meshlet> tiles;
+            generateNurbsMesh(patches, vertices, indices, &tiles);
+            doNotOptimize(vertices.data());
+            state.itemsProcessed += long(patches.size());
+        }
+    }, {4, 16, 64});
+
+    registerBenchmark("loadObjFile", [](BenchmarkState &state) {
+        std::string filename = writeTorusObj(state.range);
+        while (state.keepRunning()) {
+            std::vector<Vertex> mesh = loadObjFile(filename.c_str());
+            state.itemsProcessed += long(mesh.size());
+        }
+        std::filesystem::remove(filename);
+    }, {64, 150, 256});
+
+    registerBenchmark("loadStlFile", [](BenchmarkState &state) {
+        std::string filename = writeTorusStl(state.range);
+        while (state.keepRunning()) {
+            std::vector<Vertex> vertices;
+            std::vector<GLuint> indices;
+            loadStlFile(filename.c_str(), vertices, indices);
+            state.itemsProcessed += long(indices.size());
+        }
+        std::filesystem::remove(filename);
+    }, {64, 150, 256});
+
+    registerBenchmark("optimizeMesh", [](BenchmarkState &state) {
+        std::vector<Vertex> torus = generateCutter(torusProfile(), gridLod(state.range));
+        std::vector<Vertex> welded;
+        std::vector<GLuint> weldedIndices;
+        weldVertices(torus, welded, weldedIndices);
+
+        while (state.keepRunning()) {
+            std::vector<Vertex> vertices = welded;
+            std::vector<GLuint> indices = weldedIndices;
+            optimizeMesh(vertices, indices);
+            doNotOptimize(indices.data());
+            state.itemsProcessed += long(indices.size() / 3);
+        }
+    }, {64, 150, 256});
+
+    registerBenchmark("meshUpload", [](BenchmarkState &state) {
+        std::vector<Vertex> torus = generateCutter(torusProfile(), gridLod(state.range));
+        while (state.keepRunning()) {
+            Mesh mesh(torus.data(), torus.size(), nullptr, 0);
+            glFinish();
+            state.itemsProcessed += long(torus.size());
+        }
+    }, {64, 150, 512});
+
+    registerBenchmark("depthReadback", [](BenchmarkState &state) {
+        auto size = GLsizei(state.range);
+        DepthTarget target(size, size);
+        target.bind();
+        target.clear(DEPTH_BACKGROUND);
+
+        std::vector<GLfloat> pixels(size_t(size) * size);
+        std::vector<GLubyte> mask(size_t(size) * size);
+        while (state.keepRunning()) {
+            target.readDistance(pixels.data());
+            target.readCoverage(mask.data());
+            doNotOptimize(pixels.data());
+            doNotOptimize(mask.data());
+            state.itemsProcessed += long(pixels.size());
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }, {256, 480, 1024, 2048});
+
+    registerBenchmark("nearestClearance", [](BenchmarkState &state) {
+        size_t nrOfPixels = size_t(state.range) * size_t(state.range);
+        std::vector<GLfloat> workpiece(nrOfPixels), tool(nrOfPixels);
+        std::vector<GLubyte> toolMask(nrOfPixels);
+
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> heights(-100.f, 100.f);
+        for (size_t i = 0; i < nrOfPixels; i++) {
+            workpiece[i] = heights(random);
+            toolMask[i] = i % 4 != 0;
+            tool[i] = toolMask[i] ? heights(random) : DEPTH_BACKGROUND;
+        }
+
+        long index = 0;
+        while (state.keepRunning()) {
+            float clearance = findNearestClearance(workpiece.data(), tool.data(), toolMask.data(), nrOfPixels,
+                                                   index);
+            doNotOptimize(clearance);
+            state.itemsProcessed += long(nrOfPixels);
+        }
+    }, {256, 480, 1024, 2048});
+
+    registerBenchmark("contactCandidates", [](BenchmarkState &state) {
+        size_t nrOfPixels = size_t(state.range) * size_t(state.range);
+        std::vector<GLfloat> workpiece(nrOfPixels), tool(nrOfPixels);
+        std::vector<GLubyte> toolMask(nrOfPixels);
+
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> heights(-100.f, 100.f);
+        for (size_t i = 0; i < nrOfPixels; i++) {
+            workpiece[i] = heights(random);
+            toolMask[i] = i % 4 != 0;
+            tool[i] = toolMask[i] ? heights(random) : DEPTH_BACKGROUND;
+        }
+
+        while (state.keepRunning()) {
+            std::vector<ContactCandidate> candidates = findContactCandidates(workpiece.data(), tool.data(),
+                                                                             toolMask.data(), nrOfPixels, 256, 1.f);
+            std::vector<ContactRegion> regions = clusterContactCandidates(candidates, state.range);
+            doNotOptimize(regions.data());
+            state.itemsProcessed += long(nrOfPixels);
+        }
+    }, {256, 480, 1024, 2048});
+
+    // Reduction over the spans of a footprint covering a small part of the frame
+    registerBenchmark("sparseCandidates", [](BenchmarkState &state) {
+        CutterProfile profile(Cutter::bullNose(10.f, 2.f, 20.f));
+        size_t nrOfPixels = size_t(state.range) * size_t(state.range);
+        std::vector<GLfloat> workpiece(nrOfPixels, 60.f), tool(nrOfPixels);
+        std::vector<GLubyte> toolMask(nrOfPixels);
+        PixelSpans spans;
+
+        evaluateCutterFootprint(profile, glm::vec2(20.f), 40.f, -40.f, 40.f, -40.f, 40.f,
+                                int(state.range), int(state.range), tool.data(), toolMask.data(), BODY_CUTTER, &spans);
+
+        while (state.keepRunning()) {
+            std::vector<ContactCandidate> candidates = findContactCandidates(workpiece.data(), tool.data(),
+                                                                             toolMask.data(), spans, 256, 1.f);
+            doNotOptimize(candidates.data());
+            state.itemsProcessed += long(nrOfPixels);
+        }
+    }, {256, 480, 1024, 2048});
+
+    // Same sequence as main: coarse pass, zoom, refined pass
+    registerBenchmark("contactQuery", [&game](BenchmarkState &state) {
+        while (state.keepRunning()) {
+            game.saveDepthMap();
+            game.swapTorusAndBezier();
+
+            Pixel *p = game.calculateNearestPixel();
+
+            float zoomTolerance = 0.1;
+            game.setOrthoMatrixBounds(p->x_cord - zoomTolerance, p->x_cord + zoomTolerance,
+                                      p->y_cord - zoomTolerance, p->y_cord + zoomTolerance);
+            game.swapTorusAndBezier();
+            game.recalculateDepthMap();
+            game.swapTorusAndBezier();
+
+            Pixel *newP = game.reCalculateNearestPixel();
+
+            delete p;
+            delete newP;
+
+            state.pauseTiming();
+            game.setOrthoMatrixBounds(-13.5f, 13.5f, -13.5f, 13.5f);
+            game.swapTorusAndBezier();
+            state.resumeTiming();
+        }
+    });
+
+    // Independent tool poses on a grid over the workpiece, spread over the pose workers
+    registerBenchmark("poseBatch", [&game](BenchmarkState &state) {
+        std::vector<glm::vec3> poses;
+        for (long i = 0; i < state.range; i++)
+            poses.emplace_back(float(i % 8) * 10.f - 40.f, float(i / 8 % 8) * 10.f - 40.f, -40.f);
+
+        while (state.keepRunning()) {
+            std::vector<Pixel> results = game.evaluatePoses(poses);
+            doNotOptimize(results.data());
+            state.itemsProcessed += long(poses.size());
+        }
+    }, {8, 64});
+
+    //Same batch with two refinement levels for the poses near the workpiece; refinement chains
+    //differ in length per pose, which is what the work stealing has to even out
+    registerBenchmark("poseBatchRefined", [&game](BenchmarkState &state) {
+        std::vector<glm::vec3> poses;
+        for (long i = 0; i < state.range; i++)
+            poses.emplace_back(float(i % 8) * 10.f - 40.f, float(i / 8 % 8) * 10.f - 40.f, -40.f);
+
+        while (state.keepRunning()) {
+            std::vector<Pixel> results = game.evaluatePoses(poses, 2, 30.f);
+            doNotOptimize(results.data());
+            state.itemsProcessed += long(poses.size());
+        }
+    }, {8, 64});
+
+    return runRegisteredBenchmarks(argc, argv);
+}
@@ -4,6 +4,32 @@
 bool PROJECTION_MODE = true; // orthographic = 1, perspective = 0
 bool DISABLE_GL_READ = false;
 
+//Upper bound on how long the idle loop sleeps waiting for events, in seconds
+const double IDLE_EVENT_TIMEOUT = 0.5;
+
+//Gap left between the scene bounds and the fitted ortho near/far planes
+const float DEPTH_RANGE_MARGIN = 1.f;
+
+//Default contact candidate extraction
+const size_t CONTACT_TOP_K = 256;
+const float CONTACT_TOLERANCE = 0.01f;
+
+//Tool meshes kept across level of detail changes; enough for the assembly at a few windows
+const size_t TOOL_MESH_CACHE_SIZE = 32;
+
+//Background pixels left around the tool when the ortho window is fitted to it
+const int ORTHO_FIT_MARGIN_PIXELS = 2;
+
+//Window size of each pose refinement level relative to the level before
+const float POSE_REFINE_ZOOM = 1.f / 16.f;
+
+//Where the workpiece model is placed, built-in or loaded
+const glm::vec3 WORKPIECE_POSITION(-5.f, -5.f, -80.f);
+
+//Feature flags of the core shader permutations, see shaders/fragment_core.glsl
+const char *const SHADER_FLAG_LIGHTING = "LIGHTING";
+const char *const SHADER_FLAG_CONTACT_OUTPUT = "CONTACT_OUTPUT";
+
 
 //Private functions
 void Game::initGLFW() {
@@ -17,11 +43,13 @@ void Game::initGLFW() {
 
 void Game::initWindow(
         const char *title,
-        bool resizable) {
+        bool resizable,
+        bool visible) {
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, this->GL_VERSION_MAJOR);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, this->GL_VERSION_MINOR);
     glfwWindowHint(GLFW_RESIZABLE, resizable);
+    glfwWindowHint(GLFW_VISIBLE, visible);
 
     //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); MAC OS
 
@@ -34,7 +62,9 @@ void Game::initWindow(
     }
 
     glfwGetFramebufferSize(this->window, &this->framebufferWidth, &this->framebufferHeight);
+    glfwSetWindowUserPointer(this->window, this);
     glfwSetFramebufferSizeCallback(window, Game::framebuffer_resize_callback);
+    glfwSetWindowRefreshCallback(window, Game::window_refresh_callback);
     //IMPORTANT WITH PERSPECTIVE MATRIX!!!
 
     //glViewport(0, 0, framebufferWidth, framebufferHeight);
@@ -56,6 +86,14 @@ void Game::initGLEW() {
 
 void Game::initOpenGLOptions() {
     glEnable(GL_DEPTH_TEST);
+
+    //Reversed-Z: the near plane maps to depth 1 and the cleared background stays at 0
+    this->zeroToOneDepth = enableZeroToOneDepth();
+    glDepthFunc(GL_GREATER);
+    glClearDepth(0.0);
+
+    this->depthTarget = new DepthTarget(this->WINDOW_WIDTH, this->WINDOW_HEIGHT);
+    this->depthTarget->bind();
     // glDepthMask(GL_FALSE);
 
     // glEnable(GL_CULL_FACE);
@@ -64,6 +102,9 @@ void Game::initOpenGLOptions() {
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    //Distance and coverage outputs must be written as-is
+    glDisablei(GL_BLEND, 1);
+    glDisablei(GL_BLEND, 2);
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
@@ -77,25 +118,67 @@ void Game::initMatrices() {
     this->ViewMatrix = glm::lookAt(this->camPosition, this->camPosition + this->camFront, this->worldUp);
 
     this->ProjectionMatrix = glm::mat4(1.f);
+    this->updateProjectionMatrix();
+
+    if (!PROJECTION_MODE)
+        std::cout << glm::to_string(this->ProjectionMatrix);
+}
+
+//Tightest near/far that still contain both the tool and the workpiece, so the tool and
+//workpiece passes share one depth mapping
+void Game::fitDepthRange() {
+    float nearest = std::numeric_limits<float>::max();
+    float farthest = -std::numeric_limits<float>::max();
+
+    for (auto &body : this->toolBodies)
+        body->expandDepthRange(this->ViewMatrix, nearest, farthest);
+    for (auto &fixture : this->fixtures)
+        fixture->expandDepthRange(this->ViewMatrix, nearest, farthest);
+    if (this->bezierModel)
+        this->bezierModel->expandDepthRange(this->ViewMatrix, nearest, farthest);
+
+    //No models yet
+    if (nearest > farthest) {
+        nearest = -100.f;
+        farthest = 100.f;
+    }
+
+    this->depthNear = nearest - DEPTH_RANGE_MARGIN;
+    this->depthFar = farthest + DEPTH_RANGE_MARGIN;
+}
+
+//Near and far are passed swapped to get reversed-Z
+void Game::updateProjectionMatrix() {
     if (PROJECTION_MODE) {
-        this->ProjectionMatrix = glm::ortho(static_cast<float>(mat_left),
-                                            static_cast<float>(mat_right),
-                                            static_cast<float>(mat_bottom),
-                                            static_cast<float>(mat_top),
-                                            -100.0f, 100.0f);
+        this->fitDepthRange();
+
+        if (this->zeroToOneDepth)
+            this->ProjectionMatrix = glm::orthoRH_ZO(this->mat_left, this->mat_right, this->mat_bottom, this->mat_top,
+                                                     this->depthFar, this->depthNear);
+        else
+            this->ProjectionMatrix = glm::orthoRH_NO(this->mat_left, this->mat_right, this->mat_bottom, this->mat_top,
+                                                     this->depthFar, this->depthNear);
     } else {
-        this->ProjectionMatrix = glm::perspective(
-                glm::radians(this->fov),
-                static_cast<float>(this->framebufferWidth) / static_cast<float>(this->framebufferHeight),
-                this->nearPlane,
-                this->farPlane);
-        std::cout << glm::to_string(this->ProjectionMatrix);
+        float aspect = static_cast<float>(this->framebufferWidth) / static_cast<float>(this->framebufferHeight);
+
+        if (this->zeroToOneDepth)
+            this->ProjectionMatrix = glm::perspectiveRH_ZO(glm::radians(this->fov), aspect,
+                                                           this->farPlane, this->nearPlane);
+        else
+            this->ProjectionMatrix = glm::perspectiveRH_NO(glm::radians(this->fov), aspect,
+                                                           this->farPlane, this->nearPlane);
     }
 }
 
+//Both programs are permutations of the core shaders: the display pass is lit, the contact passes
+//skip lighting and write the distance and coverage attachments instead
 void Game::initShaders() {
     this->shaders.push_back(new Shader(this->GL_VERSION_MAJOR, this->GL_VERSION_MINOR,
-                                       (char *) "shaders/vertex_core.glsl", (char *) "shaders/fragment_core.glsl"));
+                                       (char *) "shaders/vertex_core.glsl", (char *) "shaders/fragment_core.glsl",
+                                       (char *) "", {SHADER_FLAG_LIGHTING}));
+    this->shaders.push_back(new Shader(this->GL_VERSION_MAJOR, this->GL_VERSION_MINOR,
+                                       (char *) "shaders/vertex_core.glsl", (char *) "shaders/fragment_core.glsl",
+                                       (char *) "", {SHADER_FLAG_CONTACT_OUTPUT}));
 }
 
 void Game::initMaterials() {
@@ -105,22 +188,9 @@ void Game::initMaterials() {
 
 void Game::initModels() {
 
-    std::vector<Mesh *> torusMesh;
-    std::vector<Vertex> torus = generateTorus();
-
     std::vector<Mesh *> bezierMesh;
-    std::vector<Vertex> bezier = generateTriangles();
-
-    torusMesh.push_back(
-            new Mesh(
-                    torus.data(),
-                    torus.size(),
-                    nullptr,
-                    0,
-                    glm::vec3(0.f),
-                    glm::vec3(0.f),
-                    glm::vec3(0.f),
-                    glm::vec3(1.f)));
+    std::vector<Meshlet> bezierTiles;
+    std::vector<Vertex> bezier = generateTriangles(&bezierTiles);
 
     bezierMesh.push_back(
             new Mesh(
@@ -132,25 +202,172 @@ void Game::initModels() {
                     glm::vec3(0.f, 0.f, 0.f),
                     glm::vec3(0.f),
                     glm::vec3(1.f)));
-
-    this->torusModel = new Model(
-            glm::vec3(0.f, 0.f, -40.f),
-            this->materials[0],
-            torusMesh);
+    bezierMesh.back()->setMeshlets(bezierTiles);
 
     this->bezierModel = new Model(
-            glm::vec3(-5.f, -5.f, -80.f),
+            WORKPIECE_POSITION,
             this->materials[0],
             bezierMesh);
 
-    for (auto *&i : torusMesh)
+    for (auto *&i : bezierMesh)
         delete i;
 
-    for (auto *&i : bezierMesh)
+    this->updateToolLod();
+
+}
+
+const CutterProfile &Game::cutterProfile(const Cutter &cutter) {
+    auto cached = this->cutterProfiles.find(cutter);
+
+    if (cached == this->cutterProfiles.end())
+        cached = this->cutterProfiles.emplace(cutter, CutterProfile(cutter)).first;
+
+    return cached->second;
+}
+
+//The cutter tip is the assembly origin; each holder body starts where the one below it ends
+void Game::buildToolAssembly() {
+    this->toolAssembly.clear();
+    this->toolAssembly.push_back(ToolBody{this->cutter, 0.f});
+
+    const CutterProfile &profile = this->cutterProfile(this->cutter);
+    float offset = profile.point(profile.getLength()).y;
+
+    for (auto &body : this->holderBodies) {
+        this->toolAssembly.push_back(ToolBody{body, offset});
+        offset += body.h;
+    }
+}
+
+//Tool meshes at the level of detail of the window sampled at tilesX * tilesY times its resolution.
+//Meshes are only cropped to the window while the tool is axis-aligned at unit scale; a rotated or
+//scaled tool covers other pixels than its crop, so it keeps the whole surface. The bodies keep the
+//rotation and scale of the meshes they replace.
+void Game::updateToolLod(int tilesX, int tilesY) {
+    glm::vec3 toolPosition = this->torusModel ? this->torusModel->getPosition() : glm::vec3(0.f, 0.f, -40.f);
+    glm::vec4 toolCentre = this->ViewMatrix * glm::vec4(toolPosition, 1.f);
+    bool crop = this->toolAxisAligned();
+
+    std::vector<Model *> previousBodies;
+    previousBodies.swap(this->toolBodies);
+    this->toolMeshClock++;
+
+    for (size_t b = 0; b < this->toolAssembly.size(); b++) {
+        const ToolBody &body = this->toolAssembly[b];
+        glm::vec3 bodyPosition = toolPosition + glm::vec3(0.f, 0.f, body.offset);
+
+        const CutterProfile &profile = this->cutterProfile(body.cutter);
+        CutterLod lod = selectCutterLod(profile, this->mat_left, this->mat_right, this->mat_bottom, this->mat_top,
+                                        tilesX * this->WINDOW_WIDTH, tilesY * this->WINDOW_HEIGHT,
+                                        glm::vec2(toolCentre.x, toolCentre.y), crop);
+
+        Model *lodModel;
+        auto cached = this->toolMeshes.find(std::make_pair(body, lod));
+
+        if (cached != this->toolMeshes.end()) {
+            lodModel = cached->second.model;
+            cached->second.lastUsed = this->toolMeshClock;
+            lodModel->move(bodyPosition - lodModel->getPosition());
+        } else {
+            std::vector<Mesh *> torusMesh;
+            std::vector<Vertex> torus = generateCutter(profile, lod);
+
+            torusMesh.push_back(
+                    new Mesh(
+                            torus.data(),
+                            torus.size(),
+                            nullptr,
+                            0,
+                            glm::vec3(0.f),
+                            glm::vec3(0.f),
+                            glm::vec3(0.f),
+                            glm::vec3(1.f)));
+
+            lodModel = new Model(
+                    bodyPosition,
+                    this->materials[0],
+                    torusMesh);
+
+            for (auto *&i : torusMesh)
+                delete i;
+
+            this->toolMeshes[std::make_pair(body, lod)] = ToolMesh{lodModel, this->toolMeshClock};
+        }
+
+        if (b < previousBodies.size() && previousBodies[b] != lodModel)
+            lodModel->matchOrientation(*previousBodies[b]);
+
+        lodModel->setBodyId(GLuint(BODY_CUTTER + b));
+        this->toolBodies.push_back(lodModel);
+    }
+
+    //Evict the least recently used meshes; the ones just selected are the newest and stay
+    while (this->toolMeshes.size() > std::max(TOOL_MESH_CACHE_SIZE, this->toolBodies.size())) {
+        auto oldest = this->toolMeshes.begin();
+        for (auto mesh = this->toolMeshes.begin(); mesh != this->toolMeshes.end(); mesh++)
+            if (mesh->second.lastUsed < oldest->second.lastUsed)
+                oldest = mesh;
+
+        delete oldest->second.model;
+        this->toolMeshes.erase(oldest);
+    }
+
+    this->torusModel = this->toolBodies.front();
+    this->showBodies();
+}
+
+//Models drawn by the next pass: the whole tool assembly, or the workpiece with the fixtures
+void Game::showBodies() {
+    this->models.clear();
+
+    if (this->currently_visible == TORUS) {
+        this->models = this->toolBodies;
+    } else {
+        this->models.push_back(this->bezierModel);
+        this->models.insert(this->models.end(), this->fixtures.begin(), this->fixtures.end());
+    }
+}
+
+//Places the assembly with the cutter tip at position; the crop of the meshes follows the tool
+void Game::moveTool(glm::vec3 position) {
+    this->torusModel->move(position - this->torusModel->getPosition());
+    this->updateToolLod();
+}
+
+//Rebuilds the workpiece model from the stock heights; the depth range is refitted since cutting
+//can only lower the surface
+void Game::updateStockModel() {
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<Meshlet> stockTiles;
+    generateZMapMesh(*this->stock, vertices, indices, &stockTiles);
+
+    std::vector<Mesh *> stockMesh;
+    stockMesh.push_back(
+            new Mesh(
+                    vertices.data(),
+                    vertices.size(),
+                    indices.data(),
+                    indices.size(),
+                    glm::vec3(0.f),
+                    glm::vec3(0.f),
+                    glm::vec3(0.f),
+                    glm::vec3(1.f)));
+    stockMesh.back()->setMeshlets(stockTiles);
+
+    Model *stockModel = new Model(glm::vec3(0.f), this->materials[0], stockMesh);
+    stockModel->setBodyId(BODY_WORKPIECE);
+
+    for (auto *&i : stockMesh)
         delete i;
 
-    this->models.push_back(torusModel);
+    delete this->bezierModel;
+    this->bezierModel = stockModel;
+    this->workpieceVersion++;
+    this->showBodies();
 
+    this->updateProjectionMatrix();
+    this->needsRedraw = true;
 }
 
 void Game::initLights() {
@@ -159,8 +376,10 @@ void Game::initLights() {
 
 void Game::initUniforms() {
     //INIT UNIFORMS
-    this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(ViewMatrix, "ViewMatrix");
-    this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(ProjectionMatrix, "ProjectionMatrix");
+    for (auto &shader : this->shaders) {
+        shader->setMat4fv(ViewMatrix, "ViewMatrix");
+        shader->setMat4fv(ProjectionMatrix, "ProjectionMatrix");
+    }
 
     this->shaders[SHADER_CORE_PROGRAM]->setVec3f(*this->lights[0], "lightPos0");
 }
@@ -169,28 +388,17 @@ void Game::updateUniforms() {
     //Update view matrix (camera)
     this->ViewMatrix = this->camera.getViewMatrix();
 
-    this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(this->ViewMatrix, "ViewMatrix");
-    this->shaders[SHADER_CORE_PROGRAM]->setVec3f(this->camera.getPosition(), "cameraPos");
+    for (auto &shader : this->shaders)
+        shader->setMat4fv(this->ViewMatrix, "ViewMatrix");
     this->shaders[SHADER_CORE_PROGRAM]->setVec3f(*this->lights[0], "lightPos0");
 
     //Update framebuffer size and projection matrix
     glfwGetFramebufferSize(this->window, &this->framebufferWidth, &this->framebufferHeight);
 
-    if (PROJECTION_MODE) {
-        this->ProjectionMatrix = glm::ortho(static_cast<float>(mat_left),
-                                            static_cast<float>(mat_right),
-                                            static_cast<float>(mat_bottom),
-                                            static_cast<float>(mat_top),
-                                            -100.0f, 100.0f);
-    } else {
-        this->ProjectionMatrix = glm::perspective(
-                glm::radians(this->fov),
-                static_cast<float>(this->framebufferWidth) / static_cast<float>(this->framebufferHeight),
-                this->nearPlane,
-                this->farPlane);
-    }
+    this->updateProjectionMatrix();
 
-    this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(this->ProjectionMatrix, "ProjectionMatrix");
+    for (auto &shader : this->shaders)
+        shader->setMat4fv(this->ProjectionMatrix, "ProjectionMatrix");
 }
 
 //Constructors / Destructors
@@ -198,7 +406,8 @@ Game::Game(
         const char *title,
         const int WINDOW_WIDTH, const int WINDOW_HEIGHT,
         const int GL_VERSION_MAJOR, const int GL_VERSION_MINOR,
-        bool resizable)
+        bool resizable,
+        bool visible)
         : WINDOW_WIDTH(WINDOW_WIDTH),
           WINDOW_HEIGHT(WINDOW_HEIGHT),
           GL_VERSION_MAJOR(GL_VERSION_MAJOR),
@@ -217,6 +426,11 @@ Game::Game(
     this->nearPlane = 0.001f;
     this->farPlane = 100.f;
 
+    this->depthTarget = nullptr;
+    this->zeroToOneDepth = false;
+    this->depthNear = -100.f;
+    this->depthFar = 100.f;
+
     this->dt = 0.f;
     this->curTime = 0.f;
     this->lastTime = 0.f;
@@ -229,7 +443,20 @@ Game::Game(
     this->mouseOffsetY = 0.0;
     this->firstMouse = true;
 
+    this->needsRedraw = true;
+    this->inputActive = false;
+
     this->depthPixels = (GLfloat *) malloc(4 * WINDOW_WIDTH * WINDOW_HEIGHT);
+    this->workpiecePixels = (GLfloat *) malloc(4 * WINDOW_WIDTH * WINDOW_HEIGHT);
+    this->toolMask = (GLubyte *) malloc(WINDOW_WIDTH * WINDOW_HEIGHT);
+    this->workpieceMask = (GLubyte *) malloc(WINDOW_WIDTH * WINDOW_HEIGHT);
+
+    this->contactTopK = CONTACT_TOP_K;
+    this->contactTolerance = CONTACT_TOLERANCE;
+    this->readbackTolerance = 0.f;
+
+    this->exportFormat = EXPORT_NONE;
+    this->exportCount = 0;
     this->closestPixel = 0;
     this->mat_left = -13.5;
     this->mat_right = 13.5;
@@ -237,9 +464,15 @@ Game::Game(
     this->mat_top = 13.5;
 
     this->currently_visible = TORUS;
+    this->cutter = Cutter::torus();
+    this->buildToolAssembly();
+    this->toolMeshClock = 0;
+    this->stock = nullptr;
+    this->contextPool = nullptr;
+    this->workpieceVersion = 0;
 
     this->initGLFW();
-    this->initWindow(title, resizable);
+    this->initWindow(title, resizable, visible);
     this->initGLEW();
     this->initOpenGLOptions();
 
@@ -252,8 +485,24 @@ Game::Game(
 }
 
 Game::~Game() {
-    glfwDestroyWindow(this->window);
-    glfwTerminate();
+    this->tracer.release();
+
+    //Worker objects live in the worker contexts, so they are released there before the pool stops
+    if (this->contextPool) {
+        this->contextPool->run([this](size_t worker) {
+            PoseContext &context = this->poseContexts[worker];
+
+            for (auto &vertexArray : context.vertexArrays)
+                glDeleteVertexArrays(1, &vertexArray.second);
+
+            delete context.target;
+            delete context.shader;
+        });
+
+        delete this->contextPool;
+    }
+
+    delete this->depthTarget;
 
     for (auto &shader : this->shaders)
         delete shader;
@@ -261,11 +510,25 @@ Game::~Game() {
     for (auto &material : this->materials)
         delete material;
 
-    for (auto *&i : this->models)
-        delete i;
+    for (auto &mesh : this->toolMeshes)
+        delete mesh.second.model;
+
+    delete this->bezierModel;
+    delete this->stock;
+
+    for (auto &fixture : this->fixtures)
+        delete fixture;
 
     for (auto &light : this->lights)
         delete light;
+
+    free(this->depthPixels);
+    free(this->workpiecePixels);
+    free(this->toolMask);
+    free(this->workpieceMask);
+
+    glfwDestroyWindow(this->window);
+    glfwTerminate();
 }
 
 //Accessor
@@ -273,6 +536,32 @@ int Game::getWindowShouldClose() {
     return glfwWindowShouldClose(this->window);
 }
 
+bool Game::needsRender() const {
+    return this->needsRedraw;
+}
+
+//Pixel <-> view-space transform of the current window and target size
+PixelMapping Game::pixelMapping() const {
+    return PixelMapping(this->mat_left, this->mat_right, this->mat_bottom, this->mat_top, WINDOW_WIDTH, WINDOW_HEIGHT);
+}
+
+Tracer &Game::getTracer() {
+    return this->tracer;
+}
+
+//Closest pixel of every contact region found by the last query, nearest first
+std::vector<Pixel> Game::getContactPoints() const {
+    std::vector<Pixel> points;
+
+    for (auto &region : this->contactRegions) {
+        Pixel *p = this->pixelAt(region.index, region.clearance);
+        points.push_back(*p);
+        delete p;
+    }
+
+    return points;
+}
+
 //Functions
 void Game::updateDt() {
     this->curTime = static_cast<float>(glfwGetTime());
@@ -312,39 +601,69 @@ void Game::updateKeyboardInput() {
         glfwSetWindowShouldClose(this->window, GLFW_TRUE);
     }
 
+    bool moved = false;
+
     //Camera
     if (glfwGetKey(this->window, GLFW_KEY_W) == GLFW_PRESS) {
         this->models[0]->move(glm::vec3(0.f, 0.05f, 0.f));
+        moved = true;
     }
     if (glfwGetKey(this->window, GLFW_KEY_S) == GLFW_PRESS) {
         this->models[0]->move(glm::vec3(0.f, -0.05f, 0.f));
+        moved = true;
     }
     if (glfwGetKey(this->window, GLFW_KEY_A) == GLFW_PRESS) {
         this->models[1]->rotate(glm::vec3(1.f, 0.f, 0.f));
+        moved = true;
     }
     if (glfwGetKey(this->window, GLFW_KEY_D) == GLFW_PRESS) {
         this->models[1]->rotate(glm::vec3(-1.f, 0.f, 0.f));
+        moved = true;
     }
     if (glfwGetKey(this->window, GLFW_KEY_Q) == GLFW_PRESS) {
         this->models[0]->move(glm::vec3(0.f, 0.f, 0.5f));
+        moved = true;
     }
     if (glfwGetKey(this->window, GLFW_KEY_E) == GLFW_PRESS) {
         this->models[0]->move(glm::vec3(0.f, 0.f, -0.5f));
+        moved = true;
     }
     if (glfwGetKey(this->window, GLFW_KEY_C) == GLFW_PRESS) {
         this->models[0]->scaleUp(glm::vec3(0.1f));
+        moved = true;
     }
     if (glfwGetKey(this->window, GLFW_KEY_V) == GLFW_PRESS) {
         this->models[0]->scaleUp(glm::vec3(-0.1f));
+        moved = true;
+    }
+
+    //Held keys keep the loop polling so movement stays smooth
+    if (moved) {
+        this->inputActive = true;
+        this->needsRedraw = true;
+        this->updateToolLod();
     }
 }
 
 void Game::updateInput() {
-    glfwPollEvents();
+    //Sleep until something happens unless a key was held down last frame
+    if (this->inputActive)
+        glfwPollEvents();
+    else
+        glfwWaitEventsTimeout(IDLE_EVENT_TIMEOUT);
+
+    this->inputActive = false;
 
     this->updateKeyboardInput();
     // this->updateMouseInput();
     this->camera.updateInput(dt, -1, this->mouseOffsetX, this->mouseOffsetY);
+
+    //The tool crop is in view space, so it is reselected when the view moves
+    if (this->camera.getViewMatrix() != this->ViewMatrix) {
+        this->ViewMatrix = this->camera.getViewMatrix();
+        this->needsRedraw = true;
+        this->updateToolLod();
+    }
 }
 
 void Game::update() {
@@ -362,18 +681,16 @@ void Game::update() {
 
 void Game::render() {
 
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    this->clearFrame();
 
     //Update the uniforms
     this->updateUniforms();
 
     //Render models
-    for (auto &i : this->models)
-        i->render(this->shaders[SHADER_CORE_PROGRAM]);
-    glfwSwapBuffers(window);
+    this->drawModels(SHADER_CORE_PROGRAM);
+    this->present();
 
-    glFlush();
+    this->needsRedraw = false;
 
     glBindVertexArray(0);
     glUseProgram(0);
@@ -381,83 +698,224 @@ void Game::render() {
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void Game::saveDepthMap() {
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+//The tool pass keeps the surface farthest from the camera, the underside that meets the workpiece,
+//so a shank or holder above the cutter does not hide it; the workpiece pass keeps the nearest
+void Game::clearFrame() {
+    ScopedTrace trace(this->tracer, "clear");
 
-    this->updateUniforms();
+    bool toolPass = this->currently_visible == TORUS;
+    glDepthFunc(toolPass ? GL_LESS : GL_GREATER);
+
+    this->depthTarget->bind();
+    this->depthTarget->clear(DEPTH_BACKGROUND, toolPass ? 1.f : 0.f);
+}
+
+void Game::drawModels(shader_enum program) {
+    ScopedTrace trace(this->tracer, this->currently_visible == TORUS ? "tool draw" : "workpiece draw");
+
+    transformStore().updateDirty();
 
-    //Render models
     for (auto &i : this->models)
-        i->render(this->shaders[SHADER_CORE_PROGRAM]);
+        i->render(this->shaders[program], this->ProjectionMatrix * this->ViewMatrix);
+}
+
+//Shows the offscreen target in the window
+void Game::present() {
+    this->depthTarget->blitToScreen(this->framebufferWidth, this->framebufferHeight);
     glfwSwapBuffers(window);
+}
 
-    if (!DISABLE_GL_READ)
-        glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT, GL_FLOAT, this->depthPixels);
-    else
-        for (int i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; i++)
-            this->depthPixels[i] = 0.5;
+PixelRect Game::fullFrame() const {
+    return PixelRect{0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+}
+
+//Pixels where the tool map (spans) overlaps the projected bounding boxes of the workpiece and the
+//fixtures, grown by a pixel. Contact can only happen there, so the workpiece pass reads back and
+//reduces just this rectangle.
+PixelRect Game::contactRect(const PixelSpans &spans, const glm::mat4 &ViewProjectionMatrix) const {
+    glm::vec2 low(std::numeric_limits<float>::max());
+    glm::vec2 high(-std::numeric_limits<float>::max());
+
+    this->bezierModel->expandClipBounds(ViewProjectionMatrix, low, high);
+    for (auto &fixture : this->fixtures)
+        fixture->expandClipBounds(ViewProjectionMatrix, low, high);
 
-    for (size_t i = 0; i < this->WINDOW_WIDTH * this->WINDOW_HEIGHT; i++)
-        depthPixels[i] = 200 * (depthPixels[i]) - 100;
+    if (low.x > high.x || low.y > high.y)
+        return PixelRect();
 
+    int x0 = int(std::floor((low.x * 0.5f + 0.5f) * float(WINDOW_WIDTH))) - 1;
+    int x1 = int(std::ceil((high.x * 0.5f + 0.5f) * float(WINDOW_WIDTH))) + 1;
+    int y0 = int(std::floor((low.y * 0.5f + 0.5f) * float(WINDOW_HEIGHT))) - 1;
+    int y1 = int(std::ceil((high.y * 0.5f + 0.5f) * float(WINDOW_HEIGHT))) + 1;
 
-    int initial_bottom = WINDOW_WIDTH / 2;
-    int initial_left = (WINDOW_WIDTH) * (WINDOW_HEIGHT / 2);
-    int initial_right = ((WINDOW_WIDTH) * ((WINDOW_HEIGHT / 2) + 1)) - 1;
-    int initial_top = (WINDOW_WIDTH) * (WINDOW_HEIGHT) - WINDOW_WIDTH / 2;
+    PixelRect obstacles = intersectRects(PixelRect{x0, y0, x1 - x0, y1 - y0}, this->fullFrame());
+    return intersectRects(obstacles, spansBounds(spans));
+}
 
-    int top, bottom, left, right;
+//Half floats are exact enough when every value in the map, including the background, rounds by
+//at most readbackTolerance
+bool Game::halfFloatReadback(float nearest, float farthest) const {
+    float largest = std::max({std::abs(nearest), std::abs(farthest), DEPTH_BACKGROUND});
+    return this->readbackTolerance > 0.f && halfFloatError(largest) <= this->readbackTolerance;
+}
 
-//    std::cout << initial_bottom << " " << initial_left << " " << initial_right << " " << initial_top << std::endl;
+//Reads back the view distance and coverage written by the core shader inside rect; both are used
+//as-is and pixels outside rect keep their old values. Pixels nothing was drawn into have mask 0 and
+//distance DEPTH_BACKGROUND.
+void Game::readDepth(GLfloat *pixels, GLubyte *mask, const PixelRect &rect, float fallback) {
+    ScopedTrace trace(this->tracer, "readback");
 
-//    std::cout << "Depthmap : [" << (float) this->depthPixels[initial_bottom] << ", "
-//              << (float) this->depthPixels[initial_left] << ", " << (float) this->depthPixels[initial_right] << ", "
-//              << (float) this->depthPixels[initial_top] << "]" << std::endl;
     if (!DISABLE_GL_READ) {
-//  Calculate Bottom Distance
-        int current_pixel = initial_bottom;
+        this->depthTarget->readDistance(pixels, rect, this->halfFloatReadback(this->depthNear, this->depthFar));
+        this->depthTarget->readCoverage(mask, rect);
+    } else {
+        for (int i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; i++) {
+            pixels[i] = fallback;
+            mask[i] = 1;
+        }
+    }
+}
+
+//True when the matrix neither rotates nor scales, whatever its translation
+static bool unitAxes(const glm::mat4 &matrix) {
+    for (int column = 0; column < 3; column++)
+        for (int row = 0; row < 3; row++)
+            if (std::abs(matrix[column][row] - (column == row ? 1.f : 0.f)) > 1e-5f)
+                return false;
+
+    return true;
+}
 
-        while (depthPixels[current_pixel] == 100)
-            current_pixel += WINDOW_WIDTH;
+//True while no body of the tool is rotated or scaled relative to the view, so the cutter axis is the
+//view axis and the tool is drawn at its profile size. Before the first meshes exist only the view counts.
+bool Game::toolAxisAligned() const {
+    if (this->toolBodies.empty())
+        return unitAxes(this->ViewMatrix);
 
-        bottom = current_pixel / WINDOW_WIDTH;
+    for (auto *body : this->toolBodies)
+        if (!unitAxes(this->ViewMatrix * body->meshes[0]->getModelMatrix()))
+            return false;
 
-//  Calculate Top Distance
-        current_pixel = initial_top;
-        while (depthPixels[current_pixel] == 100)
-            current_pixel -= WINDOW_WIDTH;
+    return true;
+}
 
-        top = WINDOW_HEIGHT - current_pixel / WINDOW_WIDTH - 1;
+//Evaluates every body of an axis-aligned tool assembly into distance/mask, keeping the deepest
+//surface per pixel, and their occupied spans into spans. evaluate gets the body profile, its offset
+//along the axis, the output, its ID and where to store the body's spans.
+void Game::evaluateToolAssembly(
+        const std::function<void(const CutterProfile &, float, GLfloat *, GLubyte *, GLubyte, PixelSpans *)> &evaluate,
+        GLfloat *distance, GLubyte *mask, PixelSpans &spans, size_t maxThreads) {
+    size_t nrOfPixels = size_t(WINDOW_WIDTH) * WINDOW_HEIGHT;
+    std::vector<GLfloat> bodyPixels;
+    std::vector<GLubyte> bodyMask;
+    PixelSpans bodySpans;
+
+    for (size_t b = 0; b < this->toolAssembly.size(); b++) {
+        const ToolBody &body = this->toolAssembly[b];
+        GLubyte id = GLubyte(BODY_CUTTER + b);
+
+        if (b == 0) {
+            evaluate(this->cutterProfile(body.cutter), body.offset, distance, mask, id, &spans);
+            continue;
+        }
 
-//  Calculate Left Distance
-        current_pixel = initial_left;
+        bodyPixels.resize(nrOfPixels);
+        bodyMask.resize(nrOfPixels);
+        evaluate(this->cutterProfile(body.cutter), body.offset, bodyPixels.data(), bodyMask.data(), id, &bodySpans);
+        mergeDeepestSurface(distance, mask, spans, bodyPixels.data(), bodyMask.data(), bodySpans, maxThreads);
+    }
+}
 
-        while (depthPixels[current_pixel] == 100)
-            current_pixel++;
+//Fills depthPixels/toolMask for the visible tool. While the cutter axis is the view axis the map is
+//evaluated from the cached profile, with no draw or readback; otherwise the tool mesh is rendered.
+void Game::renderToolMap() {
+    this->updateUniforms();
 
-        left = (current_pixel % WINDOW_WIDTH);
+    glm::mat4 ToolViewMatrix = this->ViewMatrix * this->torusModel->meshes[0]->getModelMatrix();
 
-//  Calculate Right Distance
-        current_pixel = initial_right;
-        while (depthPixels[current_pixel] == 100)
-            current_pixel--;
+    if (this->currently_visible == TORUS && this->toolAxisAligned() && !DISABLE_GL_READ) {
+        ScopedTrace trace(this->tracer, "tool footprint");
 
-        right = WINDOW_WIDTH - (current_pixel % WINDOW_WIDTH) - 1;
-    } else {
-        left = 24;
-        right = 24;
-        bottom = 24;
-        top = 24;
+        glm::vec2 centre(ToolViewMatrix[3].x, ToolViewMatrix[3].y);
+        float toolDistance = -ToolViewMatrix[3].z;
+
+        this->evaluateToolAssembly([&](const CutterProfile &profile, float offset, GLfloat *distance, GLubyte *mask,
+                                       GLubyte id, PixelSpans *spans) {
+            evaluateCutterFootprint(profile, centre, toolDistance - offset, this->mat_left, this->mat_right,
+                                    this->mat_bottom, this->mat_top, WINDOW_WIDTH, WINDOW_HEIGHT, distance, mask, id,
+                                    spans);
+        }, this->depthPixels, this->toolMask, this->toolSpans);
+        return;
     }
 
+    this->clearFrame();
+    this->drawModels();
+    this->present();
+
+    this->readDepth(this->depthPixels, this->toolMask, this->fullFrame());
+    this->toolSpans = maskSpans(this->toolMask, WINDOW_WIDTH, WINDOW_HEIGHT);
+}
+
+//Fills depthPixels/toolMask with the volume swept by the tool moving linearly between two origins
+//(world space). An axis-aligned tool is evaluated in one pass whatever the move length; a tilted
+//one is rendered at poses one pixel apart, keeping the deepest surface of each pixel.
+void Game::renderSweptToolMap(glm::vec3 from, glm::vec3 to) {
+    ScopedTrace trace(this->tracer, "swept footprint");
+
+    if (this->toolAxisAligned() && !DISABLE_GL_READ) {
+        glm::vec4 viewFrom = this->ViewMatrix * glm::vec4(from, 1.f);
+        glm::vec4 viewTo = this->ViewMatrix * glm::vec4(to, 1.f);
+
+        this->evaluateToolAssembly([&](const CutterProfile &profile, float offset, GLfloat *distance, GLubyte *mask,
+                                       GLubyte id, PixelSpans *spans) {
+            evaluateSweptFootprint(profile, glm::vec2(viewFrom.x, viewFrom.y), glm::vec2(viewTo.x, viewTo.y),
+                                   -viewFrom.z - offset, -viewTo.z - offset,
+                                   this->mat_left, this->mat_right, this->mat_bottom, this->mat_top,
+                                   WINDOW_WIDTH, WINDOW_HEIGHT, distance, mask, id, spans);
+        }, this->depthPixels, this->toolMask, this->toolSpans);
+        return;
+    }
+
+    size_t nrOfPixels = size_t(WINDOW_WIDTH) * WINDOW_HEIGHT;
+    std::vector<GLfloat> sweptPixels(nrOfPixels, DEPTH_BACKGROUND);
+    std::vector<GLubyte> sweptMask(nrOfPixels, 0);
+    PixelSpans sweptSpans = emptySpans(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    float pixelSize = std::min((this->mat_right - this->mat_left) / float(WINDOW_WIDTH),
+                               (this->mat_top - this->mat_bottom) / float(WINDOW_HEIGHT));
+    int steps = std::max(1, int(std::ceil(glm::length(to - from) / pixelSize)));
+
+    glm::vec3 toolPosition = this->torusModel->getPosition();
+    bool workpieceVisible = this->currently_visible == BEZIER;
+    if (workpieceVisible)
+        this->swapTorusAndBezier();
+
+    for (int k = 0; k <= steps; k++) {
+        this->moveTool(glm::mix(from, to, float(k) / float(steps)));
+        this->renderToolMap();
+
+        mergeDeepestSurface(sweptPixels.data(), sweptMask.data(), sweptSpans, this->depthPixels, this->toolMask,
+                            this->toolSpans);
+    }
+
+    this->moveTool(toolPosition);
+    if (workpieceVisible)
+        this->swapTorusAndBezier();
+
+    std::copy(sweptPixels.begin(), sweptPixels.end(), this->depthPixels);
+    std::copy(sweptMask.begin(), sweptMask.end(), this->toolMask);
+    this->toolSpans = sweptSpans;
+}
+
+//Fits the window to the tool and computes its map. Pixel coordinates follow from the window bounds
+//(see pixelMapping), so no calibration render or edge scan is needed.
+void Game::saveDepthMap() {
+    this->fitOrthoToTool();
+    this->renderToolMap();
+
+    PixelMapping mapping = this->pixelMapping();
+    std::cout << "Coordinate mapping complete. Pixel size : " << mapping.getPixelWidth() << std::endl;
 
-    float average = (float) (top + bottom + left + right) / 4;
-    float pixel_radius_outer = (float(WINDOW_WIDTH) / 2) - average;
-    float actual_radius_outer = 6.7f;
-    scaleFactor = pixel_radius_outer / actual_radius_outer;
-    //End Draw
-    std::cout << "Coordinate mapping complete. Scale factor : " << scaleFactor << std::endl;
     glFlush();
 
     glBindVertexArray(0);
@@ -469,21 +927,16 @@ void Game::saveDepthMap() {
 [[maybe_unused]] void Game::rotateBezier() {
     this->models[1]->rotate(glm::vec3(0.f, -45.f, 0.f));
     this->update();
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    this->clearFrame();
 
     this->updateUniforms();
 
     //Render models
-    for (auto &i : this->models)
-        i->render(this->shaders[SHADER_CORE_PROGRAM]);
-    glfwSwapBuffers(window);
-
-    glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT, GL_FLOAT, this->depthPixels);
+    this->drawModels();
+    this->present();
 
-    for (size_t i = 0; i < this->WINDOW_WIDTH * this->WINDOW_HEIGHT; i++) {
-        this->depthPixels[i] = 200 * (this->depthPixels[i]) - 100;
-    }
+    this->readDepth(this->depthPixels, this->toolMask, this->fullFrame());
+    this->toolSpans = maskSpans(this->toolMask, WINDOW_WIDTH, WINDOW_HEIGHT);
 
 
 
@@ -498,58 +951,60 @@ void Game::saveDepthMap() {
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+//Runs the candidate extraction on the current maps inside rect; keeps the regions and returns the
+//smallest clearance
+float Game::findContacts(const PixelRect &rect) {
+    ScopedTrace trace(this->tracer, "reduction");
+
+    std::vector<ContactCandidate> candidates = findContactCandidates(this->workpiecePixels, this->depthPixels,
+                                                                     this->toolMask, clipSpans(this->toolSpans, rect),
+                                                                     this->contactTopK, this->contactTolerance);
+    this->contactRegions = clusterContactCandidates(candidates, WINDOW_WIDTH);
+
+    if (this->contactRegions.empty())
+        return 10000.f;
+
+    this->closestPixel = this->contactRegions.front().index;
+    return this->contactRegions.front().clearance;
+}
+
+//Maps a pixel index to the view-space xy of its centre
+Pixel *Game::pixelAt(long index, float depth) const {
+    glm::vec2 centre = this->pixelMapping().pixelCentre(index);
+
+    auto *p = new Pixel;
+    p->x_cord = centre.x;
+    p->y_cord = centre.y;
+    p->index = index;
+    p->depth = depth;
+    p->toolBody = this->toolMask[index];
+    p->obstacleBody = this->workpieceMask[index];
+
+    return p;
+}
+
 Pixel *Game::calculateNearestPixel() {
 
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    this->clearFrame();
 
     this->updateUniforms();
 
     //Render models
-    for (auto &i : this->models)
-        i->render(this->shaders[SHADER_CORE_PROGRAM]);
-    glfwSwapBuffers(window);
-
-    GLfloat pixels[WINDOW_WIDTH * WINDOW_HEIGHT];
-    if (!DISABLE_GL_READ)
-        glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT, GL_FLOAT, pixels);
-    else
-        for (int i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; i++)
-            pixels[i] = 0.8;
-    float minValue = 10000.f;
-    for (size_t i = 0; i < this->WINDOW_WIDTH * this->WINDOW_HEIGHT; i++) {
-        pixels[i] = 200 * (pixels[i]) - 100;
-
-        if ((depthPixels[i] != 100) && (pixels[i] - depthPixels[i]) < minValue) {
-            minValue = (pixels[i] - depthPixels[i]);
-            this->closestPixel = i;
-        }
-    }
+    this->drawModels();
+    this->present();
 
+    //Exported maps are whole frames
+    PixelRect rect = this->exportFormat != EXPORT_NONE ? this->fullFrame()
+                                                       : this->contactRect(this->toolSpans,
+                                                                           this->ProjectionMatrix * this->ViewMatrix);
+    this->readDepth(this->workpiecePixels, this->workpieceMask, rect, 60.f);
 
-    long closest_row_cord = long(float(this->closestPixel) / float(WINDOW_WIDTH)) + 1;
-    long closest_column_cord = (this->closestPixel % WINDOW_WIDTH);
-//    std::cout << closest_column_cord << "|" << closest_row_cord << std::endl;
-    if (closest_column_cord < WINDOW_WIDTH / 2) {
-        closest_column_cord = -((WINDOW_WIDTH / 2) - closest_column_cord);
-    } else {
-        closest_column_cord -= WINDOW_WIDTH / 2;
-    }
-
-    if (closest_row_cord < WINDOW_HEIGHT / 2) {
-        closest_row_cord = -((WINDOW_HEIGHT / 2) - closest_row_cord);
-    } else {
-        closest_row_cord -= WINDOW_HEIGHT / 2;
-    }
+    float minValue = this->findContacts(rect);
 
-    float x_coord = (float) closest_column_cord / scaleFactor;
-    float y_coord = (float) closest_row_cord / scaleFactor;
+    Pixel *p = this->pixelAt(this->closestPixel, minValue);
 
-    auto *p = new Pixel;
-    p->x_cord = x_coord;
-    p->y_cord = y_coord;
-    p->index = closestPixel;
-    p->depth = minValue;
+    if (this->exportFormat != EXPORT_NONE)
+        this->exportMaps();
 
 
 //
@@ -571,23 +1026,175 @@ Pixel *Game::calculateNearestPixel() {
     return p;
 }
 
-void Game::swapTorusAndBezier() {
-    this->models.pop_back();
+//Contact query against the whole linear move of the tool origin from one point to the other: the
+//clearance is how far the move can be lowered before any part of it touches the workpiece
+Pixel *Game::calculateSweptNearestPixel(glm::vec3 from, glm::vec3 to) {
+    //The query runs in a window fitted to the whole move; the previous window is restored afterwards
+    float left = this->mat_left, right = this->mat_right, bottom = this->mat_bottom, top = this->mat_top;
+    this->fitOrthoToSweep(from, to);
+
+    this->renderSweptToolMap(from, to);
 
-    if (currently_visible == TORUS)
-        models.push_back(bezierModel);
-    else if (currently_visible == BEZIER)
-        models.push_back(torusModel);
+    bool toolVisible = this->currently_visible == TORUS;
+    if (toolVisible)
+        this->swapTorusAndBezier();
 
+    this->clearFrame();
+    this->updateUniforms();
+    this->drawModels();
+    this->present();
+    PixelRect rect = this->contactRect(this->toolSpans, this->ProjectionMatrix * this->ViewMatrix);
+    this->readDepth(this->workpiecePixels, this->workpieceMask, rect);
+
+    float minValue = this->findContacts(rect);
+
+    Pixel *p = this->pixelAt(this->closestPixel, minValue);
+
+    if (toolVisible)
+        this->swapTorusAndBezier();
+
+    this->setOrthoMatrixBounds(left, right, bottom, top);
+
+    glFlush();
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glActiveTexture(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return p;
+}
+
+//Contact query at tilesX * tilesY times the window resolution without more memory than one window of
+//maps: the window is split into tiles, each rendered with its own sub-ortho projection into the usual
+//buffers and reduced before the next. Tiles where the tool does not overlap the workpiece or fixture
+//bounds skip the workpiece pass. Candidates carry indices into the full-resolution image and are merged
+//as tiles finish, so contact regions can span tile borders and at most contactTopK are kept. Returns
+//the closest pixel of every region, nearest first, with view-space coordinates like pixelAt.
+std::vector<Pixel> Game::calculateTiledContacts(int tilesX, int tilesY) {
+    ScopedTrace trace(this->tracer, "tiled query");
+
+    float left = this->mat_left, right = this->mat_right, bottom = this->mat_bottom, top = this->mat_top;
+    float tileWidth = (right - left) / float(tilesX), tileHeight = (top - bottom) / float(tilesY);
+    long width = long(tilesX) * WINDOW_WIDTH;
+    PixelMapping mapping(left, right, bottom, top, int(width), tilesY * WINDOW_HEIGHT);
+
+    bool workpieceVisible = this->currently_visible == BEZIER;
+    if (workpieceVisible)
+        this->swapTorusAndBezier();
+
+    //An axis-aligned tool is evaluated analytically per tile; a tilted one is rendered from one mesh
+    //covering the whole window at the tiled pixel size
+    bool toolMeshRebuilt = !this->toolAxisAligned();
+    if (toolMeshRebuilt)
+        this->updateToolLod(tilesX, tilesY);
+
+    float nearest = 10000.f;
+    std::vector<ContactCandidate> candidates;
+    std::unordered_map<long, Pixel> candidatePixels;
+
+    for (int tileY = 0; tileY < tilesY; tileY++) {
+        for (int tileX = 0; tileX < tilesX; tileX++) {
+            this->mat_left = left + float(tileX) * tileWidth;
+            this->mat_right = this->mat_left + tileWidth;
+            this->mat_bottom = bottom + float(tileY) * tileHeight;
+            this->mat_top = this->mat_bottom + tileHeight;
+
+            this->renderToolMap();
+
+            PixelRect rect = this->contactRect(this->toolSpans, this->ProjectionMatrix * this->ViewMatrix);
+            if (rect.empty())
+                continue;
+
+            this->swapTorusAndBezier();
+            this->clearFrame();
+            this->updateUniforms();
+            this->drawModels();
+            this->present();
+            this->readDepth(this->workpiecePixels, this->workpieceMask, rect);
+            this->swapTorusAndBezier();
+
+            std::vector<ContactCandidate> tileCandidates = findContactCandidates(
+                    this->workpiecePixels, this->depthPixels, this->toolMask, clipSpans(this->toolSpans, rect),
+                    this->contactTopK, this->contactTolerance);
+
+            for (auto &candidate : tileCandidates) {
+                long row = long(tileY) * WINDOW_HEIGHT + candidate.index / WINDOW_WIDTH;
+                long column = long(tileX) * WINDOW_WIDTH + candidate.index % WINDOW_WIDTH;
+
+                glm::vec2 centre = mapping.pixelCentre(int(column), int(row));
+
+                Pixel p{};
+                p.index = row * width + column;
+                p.x_cord = centre.x;
+                p.y_cord = centre.y;
+                p.depth = candidate.clearance;
+                p.toolBody = this->toolMask[candidate.index];
+                p.obstacleBody = this->workpieceMask[candidate.index];
+
+                candidates.push_back({p.index, p.depth});
+                candidatePixels[p.index] = p;
+                nearest = std::min(nearest, p.depth);
+            }
+
+            //Only candidates within tolerance of the nearest so far can still be kept
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](const ContactCandidate &c) {
+                return c.clearance > nearest + this->contactTolerance;
+            }), candidates.end());
+            selectSmallest(candidates, this->contactTopK);
+
+            std::unordered_map<long, Pixel> kept;
+            for (auto &candidate : candidates)
+                kept[candidate.index] = candidatePixels[candidate.index];
+            candidatePixels.swap(kept);
+        }
+    }
+
+    this->mat_left = left;
+    this->mat_right = right;
+    this->mat_bottom = bottom;
+    this->mat_top = top;
+    if (toolMeshRebuilt)
+        this->updateToolLod();
+    this->updateUniforms();
+
+    if (workpieceVisible)
+        this->swapTorusAndBezier();
+
+    std::vector<Pixel> contacts;
+    for (auto &region : clusterContactCandidates(candidates, width))
+        contacts.push_back(candidatePixels[region.index]);
+
+    glFlush();
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glActiveTexture(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return contacts;
+}
+
+void Game::swapTorusAndBezier() {
     currently_visible = !currently_visible;
+    this->showBodies();
+
+    this->needsRedraw = true;
 }
 
 //Static functions
-void Game::framebuffer_resize_callback([[maybe_unused]] GLFWwindow *window, int fbW, int fbH) {
-    glViewport(0, 0, fbW, fbH);
+void Game::framebuffer_resize_callback(GLFWwindow *window, [[maybe_unused]] int fbW, [[maybe_unused]] int fbH) {
+    //Rendering goes to the fixed-size depth target; present() scales it to the new size
+    if (auto *game = static_cast<Game *>(glfwGetWindowUserPointer(window)))
+        game->needsRedraw = true;
+}
+
+void Game::window_refresh_callback(GLFWwindow *window) {
+    if (auto *game = static_cast<Game *>(glfwGetWindowUserPointer(window)))
+        game->needsRedraw = true;
 }
 
-void Game::changeRenderMode([[maybe_unused]] GLFWwindow *window, int key, [[maybe_unused]] int scancode, int action,
+void Game::changeRenderMode(GLFWwindow *window, int key, [[maybe_unused]] int scancode, int action,
                             [[maybe_unused]] int mods) {
     if (key == GLFW_KEY_TAB && action == GLFW_PRESS) {
         GLint polygonMode;
@@ -611,58 +1218,215 @@ void Game::changeRenderMode([[maybe_unused]] GLFWwindow *window, int key, [[mayb
     }
     if (key == GLFW_KEY_RIGHT_SHIFT && action == GLFW_PRESS) {
     }
+
+    if ((key == GLFW_KEY_TAB || key == GLFW_KEY_CAPS_LOCK) && action == GLFW_PRESS) {
+        if (auto *game = static_cast<Game *>(glfwGetWindowUserPointer(window)))
+            game->needsRedraw = true;
+    }
 }
 
-[[maybe_unused]] GLfloat *Game::reCalculateClosestPoint(GLfloat *) {
-    return nullptr;
+//Creates count worker threads with their own contexts for evaluatePoses; each compiles (or loads from
+//the binary cache) its own program, since uniforms are per program and the workers set them concurrently.
+//Returns the number of workers running, which is fewer than count when a worker window fails to open.
+size_t Game::startPoseWorkers(size_t count) {
+    if (this->contextPool)
+        return this->poseContexts.size();
+
+    this->contextPool = new ContextPool(this->window, count);
+    this->poseContexts.resize(this->contextPool->size());
+
+    this->contextPool->run([this](size_t worker) {
+        PoseContext &context = this->poseContexts[worker];
+
+        context.target = new DepthTarget(WINDOW_WIDTH, WINDOW_HEIGHT);
+        context.shader = new Shader(this->GL_VERSION_MAJOR, this->GL_VERSION_MINOR,
+                                    (char *) "shaders/vertex_core.glsl", (char *) "shaders/fragment_core.glsl",
+                                    (char *) "", {SHADER_FLAG_CONTACT_OUTPUT});
+        context.workpieceVersion = this->workpieceVersion;
+
+        context.workpiece.resize(size_t(WINDOW_WIDTH) * WINDOW_HEIGHT);
+        context.workpieceMask.resize(size_t(WINDOW_WIDTH) * WINDOW_HEIGHT);
+        context.tool.resize(size_t(WINDOW_WIDTH) * WINDOW_HEIGHT);
+        context.toolMask.resize(size_t(WINDOW_WIDTH) * WINDOW_HEIGHT);
+
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_GREATER);
+        if (this->zeroToOneDepth)
+            glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+    });
+
+    return this->poseContexts.size();
 }
 
-void Game::initialRender() {
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+//Contact query for every tool origin in poses (world space), spread over the pose workers. Each pose
+//gets a window of the current size centred on it: the workpiece and fixtures are rendered by the worker,
+//the tool map is evaluated from the profiles, so the tool must be axis-aligned. Poses whose coarse
+//clearance is below refineBelow get up to refinements more passes, each POSE_REFINE_ZOOM times the
+//window of the last and centred on the contact found so far. Pixel coordinates are relative to the
+//pose; depth is the clearance. Empty when the poses cannot be evaluated.
+std::vector<Pixel> Game::evaluatePoses(const std::vector<glm::vec3> &poses, int refinements, float refineBelow) {
+    if (!this->toolAxisAligned()) {
+        std::cout << "ERROR::GAME::POSE_WORKERS_NEED_AXIS_ALIGNED_TOOL"
+                  << "\n";
+        return {};
+    }
 
-    //Update the uniforms
-    this->updateUniforms();
+    if (!this->contextPool)
+        this->startPoseWorkers(std::max(1u, std::thread::hardware_concurrency()));
 
-    //Render models
-    for (auto &i : this->models)
-        i->render(this->shaders[SHADER_CORE_PROGRAM]);
-    glfwSwapBuffers(window);
+    if (this->poseContexts.empty()) {
+        std::cout << "ERROR::GAME::NO_POSE_WORKERS"
+                  << "\n";
+        return {};
+    }
+
+    std::vector<Pixel> results(poses.size());
+
+    ScopedTrace trace(this->tracer, "pose batch");
+
+    //Everything the workers read must be settled on this thread: matrices composed, profiles cached,
+    //uploads finished
+    transformStore().updateDirty();
+    for (auto &body : this->toolAssembly)
+        this->cutterProfile(body.cutter);
+
+    float nearest = std::numeric_limits<float>::max();
+    float farthest = -std::numeric_limits<float>::max();
+    this->bezierModel->expandDepthRange(this->ViewMatrix, nearest, farthest);
+    for (auto &fixture : this->fixtures)
+        fixture->expandDepthRange(this->ViewMatrix, nearest, farthest);
+
+    glFinish();
+
+    float depthNear = nearest - DEPTH_RANGE_MARGIN, depthFar = farthest + DEPTH_RANGE_MARGIN;
+    float halfWidth = 0.5f * (this->mat_right - this->mat_left);
+    float halfHeight = 0.5f * (this->mat_top - this->mat_bottom);
+
+    //Every pass is one job, so a pose that needs several refinement levels does not hold up the rest
+    //of its worker's share: the levels are queued one at a time and idle workers steal what is left
+    size_t workers = this->poseContexts.size();
+    WorkStealingScheduler scheduler(workers);
+
+    std::function<void(size_t, size_t, int)> refine = [&](size_t worker, size_t k, int level) {
+        glm::vec4 pose = this->ViewMatrix * glm::vec4(poses[k], 1.f);
+        glm::vec2 contact(pose.x + results[k].x_cord, pose.y + results[k].y_cord);
+        float zoom = std::pow(POSE_REFINE_ZOOM, float(level));
 
-    GLfloat pixels[WINDOW_WIDTH * WINDOW_HEIGHT];
-    glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT, GL_FLOAT, pixels);
+        Pixel refined = this->evaluatePoseWindow(this->poseContexts[worker], pose, contact,
+                                                 halfWidth * zoom, halfHeight * zoom, depthNear, depthFar);
+        if (refined.depth <= results[k].depth)
+            results[k] = refined;
 
+        if (level < refinements)
+            scheduler.push(worker, [&refine, k, level](size_t next) { refine(next, k, level + 1); });
+    };
 
-    for (size_t i = 0; i < this->WINDOW_WIDTH * this->WINDOW_HEIGHT; i++) {
-        pixels[i] = 200 * (pixels[i]) - 100;
-        // pixels[i] = pixels[i] - this->depthPixels[i];
+    //Contiguous shares keep neighbouring poses, which render alike, on one worker until stolen
+    for (size_t k = 0; k < poses.size(); k++) {
+        scheduler.push(k * workers / poses.size(), [&, k](size_t worker) {
+            glm::vec4 pose = this->ViewMatrix * glm::vec4(poses[k], 1.f);
+
+            results[k] = this->evaluatePoseWindow(this->poseContexts[worker], pose, glm::vec2(pose.x, pose.y),
+                                                  halfWidth, halfHeight, depthNear, depthFar);
+
+            if (refinements > 0 && results[k].depth < refineBelow)
+                scheduler.push(worker, [&refine, k](size_t next) { refine(next, k, 1); });
+        });
     }
 
+    this->contextPool->run([&](size_t worker) {
+        this->preparePoseContext(this->poseContexts[worker]);
+        scheduler.work(worker);
+    });
 
-    glFlush();
+    return results;
+}
 
-    glBindVertexArray(0);
-    glUseProgram(0);
-    glActiveTexture(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+//Drops vertex arrays of a replaced workpiece and loads the view uniforms shared by every pose
+void Game::preparePoseContext(PoseContext &context) {
+    if (context.workpieceVersion != this->workpieceVersion) {
+        for (auto &vertexArray : context.vertexArrays)
+            glDeleteVertexArrays(1, &vertexArray.second);
+
+        context.vertexArrays.clear();
+        context.workpieceVersion = this->workpieceVersion;
+    }
+
+    context.shader->setMat4fv(this->ViewMatrix, "ViewMatrix");
 }
 
-void Game::recalculateDepthMap() {
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+//One contact pass for the tool at pose (view space) over the window of the given half size around centre
+Pixel Game::evaluatePoseWindow(PoseContext &context, glm::vec4 pose, glm::vec2 centre, float halfWidth,
+                               float halfHeight, float depthNear, float depthFar) {
+    float left = centre.x - halfWidth, right = centre.x + halfWidth;
+    float bottom = centre.y - halfHeight, top = centre.y + halfHeight;
 
-    this->updateUniforms();
+    glm::mat4 Projection = this->zeroToOneDepth ? glm::orthoRH_ZO(left, right, bottom, top, depthFar, depthNear)
+                                                : glm::orthoRH_NO(left, right, bottom, top, depthFar, depthNear);
 
-    for (auto &i : this->models)
-        i->render(this->shaders[SHADER_CORE_PROGRAM]);
-    glfwSwapBuffers(window);
+    //Tool first: its spans bound the workpiece readback. Each pose worker is already one thread of a
+    //full pool, so the footprint is evaluated serially
+    this->evaluateToolAssembly([&](const CutterProfile &profile, float offset, GLfloat *distance, GLubyte *mask,
+                                   GLubyte id, PixelSpans *spans) {
+        evaluateCutterFootprint(profile, glm::vec2(pose.x, pose.y), -pose.z - offset, left, right, bottom, top,
+                                WINDOW_WIDTH, WINDOW_HEIGHT, distance, mask, id, spans, 1);
+    }, context.tool.data(), context.toolMask.data(), context.toolSpans, 1);
+
+    PixelRect rect = this->contactRect(context.toolSpans, Projection * this->ViewMatrix);
+
+    long index = 0;
+    float clearance = 10000.f;
+
+    if (!rect.empty()) {
+        context.shader->setMat4fv(Projection, "ProjectionMatrix");
+
+        context.target->bind();
+        context.target->clear(DEPTH_BACKGROUND);
+
+        this->bezierModel->render(context.shader, Projection * this->ViewMatrix, context.vertexArrays);
+        for (auto &fixture : this->fixtures)
+            fixture->render(context.shader, Projection * this->ViewMatrix, context.vertexArrays);
+
+        context.target->readDistance(context.workpiece.data(), rect, this->halfFloatReadback(depthNear, depthFar));
+        context.target->readCoverage(context.workpieceMask.data(), rect);
+
+        clearance = findNearestClearance(context.workpiece.data(), context.tool.data(), context.toolMask.data(),
+                                         clipSpans(context.toolSpans, rect), index);
+    }
+
+    Pixel result{};
+    result.index = index;
+    glm::vec2 contact = PixelMapping(left, right, bottom, top, WINDOW_WIDTH, WINDOW_HEIGHT).pixelCentre(index);
+    result.x_cord = contact.x - pose.x;
+    result.y_cord = contact.y - pose.y;
+    result.depth = clearance;
+    result.toolBody = rect.empty() ? 0 : context.toolMask[index];
+    result.obstacleBody = rect.empty() ? 0 : context.workpieceMask[index];
 
+    return result;
+}
+
+//Draws the tool and the workpiece pass once each and waits for the GPU, without reading back, so
+//deferred shader compilation, buffer uploads and state validation are done before the first query
+void Game::warmUp() {
+    ScopedTrace trace(this->tracer, "warm-up");
+
+    for (int pass = 0; pass < 2; pass++) {
+        this->clearFrame();
+        this->updateUniforms();
+        this->drawModels();
+        this->swapTorusAndBezier();
+    }
 
-    glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT, GL_FLOAT, this->depthPixels);
+    glFinish();
+}
 
+[[maybe_unused]] GLfloat *Game::reCalculateClosestPoint(GLfloat *) {
+    return nullptr;
+}
 
-    for (size_t i = 0; i < this->WINDOW_WIDTH * this->WINDOW_HEIGHT; i++)
-        depthPixels[i] = 200 * (depthPixels[i]) - 100;
+void Game::recalculateDepthMap() {
+    this->renderToolMap();
 
 
     glFlush();
@@ -680,55 +1444,311 @@ void Game::setOrthoMatrixBounds(float left, float right, float bottom, float top
     this->mat_bottom = bottom;
     this->mat_top = top;
 
+    this->updateToolLod();
     this->updateUniforms();
+
+    this->needsRedraw = true;
 }
 
-Pixel *Game::reCalculateNearestPixel() {
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    this->updateUniforms();
-    for (auto &i : this->models)
-        i->render(this->shaders[SHADER_CORE_PROGRAM]);
-    glfwSwapBuffers(window);
-    GLfloat pixels[WINDOW_WIDTH * WINDOW_HEIGHT];
-
-    glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_COMPONENT, GL_FLOAT, pixels);
-    float minValue = 10000.f;
-    for (size_t i = 0; i < this->WINDOW_WIDTH * this->WINDOW_HEIGHT; i++) {
-        float a, b;
-
-        pixels[i] = 200 * (pixels[i]) - 100;
-        a = pixels[i];
-        b = depthPixels[i];
-        if ((depthPixels[i] != 100) && (pixels[i] - depthPixels[i]) < minValue) {
-            minValue = (pixels[i] - depthPixels[i]);
-            this->closestPixel = i;
-        }
-    }
+//Centres the window on the tool axis with square pixels, just covering the widest body of the assembly
+void Game::fitOrthoToTool() {
+    glm::vec4 toolOrigin = this->ViewMatrix * glm::vec4(this->torusModel->getPosition(), 1.f);
+
+    float radius = 0.f;
+    for (auto &body : this->toolAssembly)
+        radius = std::max(radius, this->cutterProfile(body.cutter).getSilhouetteRadius());
+
+    PixelMapping fitted = PixelMapping::fitted(glm::vec2(toolOrigin.x, toolOrigin.y), radius,
+                                               WINDOW_WIDTH, WINDOW_HEIGHT, ORTHO_FIT_MARGIN_PIXELS);
 
-    long closest_row_cord = long(float(this->closestPixel) / float(WINDOW_WIDTH)) + 1;
-    long closest_column_cord = (this->closestPixel % WINDOW_WIDTH);
+    this->setOrthoMatrixBounds(fitted.getLeft(), fitted.getRight(), fitted.getBottom(), fitted.getTop());
+}
+
+//Fits the window with square pixels around the silhouette of the tool swept linearly between two
+//origins (world space), so no part of the move falls outside the maps
+void Game::fitOrthoToSweep(glm::vec3 from, glm::vec3 to) {
+    glm::vec4 toolOrigin = this->ViewMatrix * glm::vec4(this->torusModel->getPosition(), 1.f);
+    glm::vec2 low(std::numeric_limits<float>::max()), high(std::numeric_limits<float>::lowest());
+
+    if (this->toolAxisAligned()) {
+        float radius = 0.f;
+        for (auto &body : this->toolAssembly)
+            radius = std::max(radius, this->cutterProfile(body.cutter).getSilhouetteRadius());
 
-    if (closest_column_cord < WINDOW_WIDTH / 2) {
-        closest_column_cord = -((WINDOW_WIDTH / 2) - closest_column_cord);
+        low = glm::vec2(toolOrigin.x, toolOrigin.y) - glm::vec2(radius);
+        high = glm::vec2(toolOrigin.x, toolOrigin.y) + glm::vec2(radius);
     } else {
-        closest_column_cord -= WINDOW_WIDTH / 2;
+        //A tilted tool is never cropped (see updateToolLod), so its bounding boxes cover all of it
+        for (auto *body : this->toolBodies)
+            body->expandClipBounds(this->ViewMatrix, low, high);
+    }
+
+    //The silhouette at the current origin, shifted to both ends of the move
+    glm::vec4 viewFrom = this->ViewMatrix * glm::vec4(from, 1.f);
+    glm::vec4 viewTo = this->ViewMatrix * glm::vec4(to, 1.f);
+    glm::vec2 shiftFrom(viewFrom.x - toolOrigin.x, viewFrom.y - toolOrigin.y);
+    glm::vec2 shiftTo(viewTo.x - toolOrigin.x, viewTo.y - toolOrigin.y);
+
+    PixelMapping fitted = PixelMapping::fitted(glm::min(low + shiftFrom, low + shiftTo),
+                                               glm::max(high + shiftFrom, high + shiftTo),
+                                               WINDOW_WIDTH, WINDOW_HEIGHT, ORTHO_FIT_MARGIN_PIXELS);
+
+    this->setOrthoMatrixBounds(fitted.getLeft(), fitted.getRight(), fitted.getBottom(), fitted.getTop());
+}
+
+void Game::setMapExport(export_format format, const char *prefix) {
+    this->exportFormat = format;
+    this->exportPrefix = prefix;
+    this->exportCount = 0;
+}
+
+void Game::setCutter(const Cutter &cutter) {
+    this->cutter = cutter;
+
+    this->buildToolAssembly();
+    this->updateToolLod();
+    this->needsRedraw = true;
+}
+
+//A shank cylinder on top of the cutter and a holder cylinder on top of the shank; lengths of 0 remove them
+void Game::setToolHolder(float shankDiameter, float shankLength, float holderDiameter, float holderLength) {
+    this->holderBodies.clear();
+
+    if (shankLength > 0.f)
+        this->holderBodies.push_back(Cutter::flat(shankDiameter, shankLength));
+    if (holderLength > 0.f)
+        this->holderBodies.push_back(Cutter::flat(holderDiameter, holderLength));
+
+    this->buildToolAssembly();
+    this->updateToolLod();
+    this->updateProjectionMatrix();
+    this->needsRedraw = true;
+}
+
+//Adds a box-shaped fixture (world space) that is drawn, and checked for contact, with the workpiece
+void Game::addFixture(glm::vec3 min, glm::vec3 max) {
+    Box box(min, max);
+
+    std::vector<Mesh *> fixtureMesh;
+    fixtureMesh.push_back(new Mesh(&box));
+
+    Model *fixture = new Model(glm::vec3(0.f), this->materials[0], fixtureMesh);
+    fixture->setBodyId(GLuint(BODY_FIXTURE + this->fixtures.size()));
+
+    for (auto *&i : fixtureMesh)
+        delete i;
+
+    this->fixtures.push_back(fixture);
+    this->workpieceVersion++;
+
+    this->showBodies();
+    this->updateProjectionMatrix();
+    this->needsRedraw = true;
+}
+
+//Adds a fixture from a binary STL file, in world coordinates
+void Game::addFixtureMesh(const char *fileName) {
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    if (!loadStlFile(fileName, vertices, indices) || indices.empty())
+        return;
+
+    optimizeMesh(vertices, indices);
+
+    std::vector<Mesh *> fixtureMesh;
+    fixtureMesh.push_back(
+            new Mesh(
+                    vertices.data(),
+                    vertices.size(),
+                    indices.data(),
+                    indices.size()));
+
+    Model *fixture = new Model(glm::vec3(0.f), this->materials[0], fixtureMesh);
+    fixture->setBodyId(GLuint(BODY_FIXTURE + this->fixtures.size()));
+
+    for (auto *&i : fixtureMesh)
+        delete i;
+
+    this->fixtures.push_back(fixture);
+    this->workpieceVersion++;
+
+    this->showBodies();
+    this->updateProjectionMatrix();
+    this->needsRedraw = true;
+}
+
+//Creates the stock on a grid over the current ortho window, one cell per pixel. It is either a
+//flat block with its top at height, or the current workpiece surface raised by height (the
+//finishing allowance), read from a workpiece pass. Assumes the camera looks down -z; the Z-map cells
+//are square, so the window pixels must be too.
+void Game::createStock(bool fromWorkpiece, float height) {
+    ScopedTrace trace(this->tracer, "stock");
+
+    PixelMapping mapping = this->pixelMapping();
+    if (std::abs(mapping.getPixelWidth() - mapping.getPixelHeight()) > 1e-4f * mapping.getPixelWidth()) {
+        std::cout << "ERROR::GAME::STOCK_NEEDS_SQUARE_PIXELS: " << mapping.getPixelWidth() << " x "
+                  << mapping.getPixelHeight() << "\n";
+        return;
     }
 
-    if (closest_row_cord < WINDOW_HEIGHT / 2) {
-        closest_row_cord = -((WINDOW_HEIGHT / 2) - closest_row_cord);
+    glm::vec2 origin(this->mat_left + this->camPosition.x, this->mat_bottom + this->camPosition.y);
+    ZMap *created;
+
+    if (fromWorkpiece) {
+        bool toolVisible = this->currently_visible == TORUS;
+        if (toolVisible)
+            this->swapTorusAndBezier();
+
+        this->clearFrame();
+        this->updateUniforms();
+        this->drawModels();
+        this->present();
+        this->readDepth(this->workpiecePixels, this->workpieceMask, this->fullFrame());
+
+        if (toolVisible)
+            this->swapTorusAndBezier();
+
+        created = new ZMap(this->workpiecePixels, this->workpieceMask,
+                           origin.x, origin.x + this->mat_right - this->mat_left, origin.y,
+                           WINDOW_WIDTH, WINDOW_HEIGHT, this->camPosition.z, height);
     } else {
-        closest_row_cord -= WINDOW_HEIGHT / 2;
+        created = new ZMap(origin, (this->mat_right - this->mat_left) / float(WINDOW_WIDTH),
+                           WINDOW_WIDTH, WINDOW_HEIGHT, height);
     }
 
-    float x_coord = (float) closest_column_cord / scaleFactor;
-    float y_coord = (float) closest_row_cord / scaleFactor;
+    delete this->stock;
+    this->stock = created;
 
-    auto *p = new Pixel;
-    p->x_cord = x_coord;
-    p->y_cord = y_coord;
-    p->index = closestPixel;
-    p->depth = minValue;
+    this->updateStockModel();
+}
+
+//Replaces the workpiece with the NURBS patches of fileName, tessellated into one indexed mesh; the
+//depth range is refitted to the new surface
+void Game::loadWorkpiece(const char *fileName) {
+    ScopedTrace trace(this->tracer, "workpiece load");
+
+    std::vector<NurbsPatch> patches = loadNurbsPatches(fileName);
+    if (patches.empty()) {
+        std::cout << "ERROR::GAME::NO_WORKPIECE_PATCHES"
+                  << "\n";
+        return;
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<Meshlet> workpieceTiles;
+    generateNurbsMesh(patches, vertices, indices, &workpieceTiles);
+
+    std::vector<Mesh *> workpieceMesh;
+    workpieceMesh.push_back(
+            new Mesh(
+                    vertices.data(),
+                    vertices.size(),
+                    indices.data(),
+                    indices.size(),
+                    glm::vec3(0.f),
+                    glm::vec3(0.f),
+                    glm::vec3(0.f),
+                    glm::vec3(1.f)));
+    workpieceMesh.back()->setMeshlets(workpieceTiles);
+
+    Model *workpieceModel = new Model(WORKPIECE_POSITION, this->materials[0], workpieceMesh);
+    workpieceModel->setBodyId(BODY_WORKPIECE);
+
+    for (auto *&i : workpieceMesh)
+        delete i;
+
+    delete this->bezierModel;
+    this->bezierModel = workpieceModel;
+    this->workpieceVersion++;
+    this->showBodies();
+
+    this->updateProjectionMatrix();
+    this->needsRedraw = true;
+}
+
+//Writes the current workpiece (built-in, loaded or cut stock) in world coordinates as binary STL
+void Game::exportWorkpiece(const char *fileName) const {
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    for (auto &mesh : this->bezierModel->meshes) {
+        glm::mat4 ModelMatrix = mesh->getModelMatrix();
+        GLuint base = GLuint(vertices.size());
+
+        for (unsigned i = 0; i < mesh->getNrOfVertices(); i++) {
+            vertices.push_back(mesh->getVertices()[i]);
+            vertices.back().position = glm::vec3(ModelMatrix * glm::vec4(vertices.back().position, 1.f));
+        }
+
+        if (mesh->getNrOfIndices() > 0)
+            for (unsigned i = 0; i < mesh->getNrOfIndices(); i++)
+                indices.push_back(base + mesh->getIndices()[i]);
+        else
+            for (unsigned i = 0; i < mesh->getNrOfVertices(); i++)
+                indices.push_back(base + i);
+    }
+
+    saveStlFile(fileName, vertices.data(), indices.data(), indices.size());
+}
+
+//Sweeps the current cutter (axis along +z) through the tool origins of toolpath, with linear moves
+//between them, and removes the material it passes through
+void Game::cutStock(const std::vector<glm::vec3> &toolpath) {
+    if (!this->stock) {
+        std::cout << "ERROR::GAME::NO_STOCK"
+                  << "\n";
+        return;
+    }
+
+    {
+        ScopedTrace trace(this->tracer, "material removal");
+
+        this->stock->cut(this->cutter, ZMap::interpolatePath(toolpath, this->stock->getCellSize()));
+    }
+
+    this->updateStockModel();
+}
+
+void Game::setContactTolerance(float tolerance, size_t topK) {
+    this->contactTolerance = tolerance;
+    this->contactTopK = topK;
+}
+
+void Game::setReadbackTolerance(float tolerance) {
+    this->readbackTolerance = tolerance;
+}
+
+void Game::exportMaps() {
+    std::string base = this->exportPrefix + "_" + std::to_string(this->exportCount++);
+    const char *extension = exportExtension(this->exportFormat);
+
+    exportClearanceMap(base + "_clearance" + extension, this->exportFormat,
+                       this->workpiecePixels, this->depthPixels, this->toolMask, WINDOW_WIDTH, WINDOW_HEIGHT);
+    exportFloatMap(base + "_workpiece" + extension, this->exportFormat,
+                   this->workpiecePixels, WINDOW_WIDTH, WINDOW_HEIGHT);
+    exportFloatMap(base + "_tool" + extension, this->exportFormat,
+                   this->depthPixels, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    std::cout << "Maps exported to " << base << "_*" << extension << std::endl;
+}
+
+Pixel *Game::reCalculateNearestPixel() {
+    this->clearFrame();
+    this->updateUniforms();
+    this->drawModels();
+    this->present();
+    PixelRect rect = this->exportFormat != EXPORT_NONE ? this->fullFrame()
+                                                       : this->contactRect(this->toolSpans,
+                                                                           this->ProjectionMatrix * this->ViewMatrix);
+    this->readDepth(this->workpiecePixels, this->workpieceMask, rect);
+
+    float minValue = this->findContacts(rect);
+
+    Pixel *p = this->pixelAt(this->closestPixel, minValue);
+
+    if (this->exportFormat != EXPORT_NONE)
+        this->exportMaps();
 
 
 
@@ -750,8 +1770,5 @@ Pixel *Game::reCalculateNearestPixel() {
     return p;
 }
 
-void Game::setNewScaleFactor(float tolerance) {
-    this->scaleFactor = float(WINDOW_WIDTH) / tolerance;
-}
 
 
@@ -4,10 +4,24 @@
 #include "headers/include_libs.h"
 #include "headers/camera.h"
 #include "headers/objectLoader.h"
+#include "headers/generater_functions.h"
+#include "headers/depthExport.h"
+#include "headers/contact.h"
+#include "headers/trace.h"
+#include "headers/depthTarget.h"
+#include "headers/zmap.h"
+#include "headers/contextPool.h"
+#include "headers/workStealing.h"
+#include "headers/pixelMapping.h"
+
+#include <map>
+#include <functional>
+#include <limits>
 
 //ENUMERATIONS
 enum shader_enum {
-    SHADER_CORE_PROGRAM = 0
+    SHADER_CORE_PROGRAM = 0,
+    SHADER_CONTACT_PROGRAM
 };
 enum texture_enum {
     TEX_PUSHEEN [[maybe_unused]] = 0,
@@ -34,6 +48,29 @@ public:
     float x_cord;
     float y_cord;
     float depth;
+    //Tool body and obstacle (workpiece or fixture) meeting at this pixel; see tool_body_enum/obstacle_body_enum
+    int toolBody;
+    int obstacleBody;
+};
+
+//Cached tool mesh of one body and level of detail, with the updateToolLod call that last used it
+struct ToolMesh {
+    Model *model;
+    unsigned long lastUsed;
+};
+
+//GL state of one pose worker; vertex arrays and framebuffers cannot be shared between contexts
+struct PoseContext {
+    DepthTarget *target;
+    Shader *shader;
+    std::map<const Mesh *, GLuint> vertexArrays;
+    size_t workpieceVersion;
+
+    std::vector<GLfloat> workpiece;
+    std::vector<GLubyte> workpieceMask;
+    std::vector<GLfloat> tool;
+    std::vector<GLubyte> toolMask;
+    PixelSpans toolSpans;
 };
 
 class Game {
@@ -64,6 +101,10 @@ private:
     double mouseOffsetY;
     bool firstMouse;
 
+    //On-demand rendering
+    bool needsRedraw;
+    bool inputActive;
+
     //Camera
     Camera camera;
 
@@ -78,6 +119,12 @@ private:
     float nearPlane;
     float farPlane;
 
+    //Depth (reversed-Z into a float target, ortho planes fitted to the scene)
+    DepthTarget *depthTarget;
+    bool zeroToOneDepth;
+    float depthNear;
+    float depthFar;
+
     //Shaders
     std::vector<Shader *> shaders;
 
@@ -91,6 +138,29 @@ private:
     std::vector<glm::vec3 *> lights;
 
     GLfloat *depthPixels;
+    GLfloat *workpiecePixels;
+
+    //Coverage of depthPixels / workpiecePixels, non-zero where a surface was drawn
+    GLubyte *toolMask;
+    GLubyte *workpieceMask;
+
+    //Occupied part of depthPixels / toolMask; reductions only read the workpiece inside it
+    PixelSpans toolSpans;
+
+    Tracer tracer;
+
+    //Contact candidates: up to contactTopK pixels within contactTolerance of the minimum
+    size_t contactTopK;
+    float contactTolerance;
+    std::vector<ContactRegion> contactRegions;
+
+    //Distance maps are read back as half floats when their rounding error stays within this (0: never)
+    float readbackTolerance;
+
+    //Map export
+    export_format exportFormat;
+    std::string exportPrefix;
+    int exportCount;
 
 //    Ortho matrix stuff
 
@@ -104,12 +174,38 @@ private:
     Model *bezierModel{};
     Model *torusModel{};
 
+    //Current tool; profiles and meshes per body and level of detail are built on first use, and the
+    //least recently used meshes are deleted once more than TOOL_MESH_CACHE_SIZE are kept
+    Cutter cutter{};
+    std::map<Cutter, CutterProfile> cutterProfiles;
+    std::map<std::pair<ToolBody, CutterLod>, ToolMesh> toolMeshes;
+    unsigned long toolMeshClock;
+
+    //Tool assembly: the cutter, then the holder bodies (shank, holder) stacked on top of it.
+    //toolBodies are the models of the current level of detail, in assembly order.
+    std::vector<Cutter> holderBodies;
+    std::vector<ToolBody> toolAssembly;
+    std::vector<Model *> toolBodies;
+
+    //Static obstacles drawn with the workpiece
+    std::vector<Model *> fixtures;
+
+    //Pose evaluation on worker contexts; workpieceVersion changes whenever the workpiece or fixture
+    //meshes are replaced, so workers drop vertex arrays of deleted meshes
+    ContextPool *contextPool;
+    std::vector<PoseContext> poseContexts;
+    size_t workpieceVersion;
+
+    //Material removal: once created, the stock replaces the workpiece model
+    ZMap *stock;
+
 //Private functions
     static void initGLFW();
 
     void initWindow(
             const char *title,
-            bool resizable
+            bool resizable,
+            bool visible
     );
 
     static void initGLEW(); //AFTER CONTEXT CREATION!!!
@@ -117,6 +213,10 @@ private:
 
     void initMatrices();
 
+    void fitDepthRange();
+
+    void updateProjectionMatrix();
+
     void initShaders();
 
     void initMaterials();
@@ -125,17 +225,62 @@ private:
 
     void initLights();
 
+    const CutterProfile &cutterProfile(const Cutter &cutter);
+
+    void buildToolAssembly();
+
+    void updateToolLod(int tilesX = 1, int tilesY = 1);
+
+    void showBodies();
+
+    void moveTool(glm::vec3 position);
+
+    void updateStockModel();
+
     void initUniforms();
 
     void updateUniforms();
 
+    void exportMaps();
+
+    void clearFrame();
+
+    void drawModels(shader_enum program = SHADER_CONTACT_PROGRAM);
+
+    void present();
+
+    PixelRect fullFrame() const;
+
+    PixelRect contactRect(const PixelSpans &spans, const glm::mat4 &ViewProjectionMatrix) const;
+
+    bool halfFloatReadback(float nearest, float farthest) const;
+
+    void readDepth(GLfloat *pixels, GLubyte *mask, const PixelRect &rect, float fallback = 0.f);
+
+    bool toolAxisAligned() const;
+
+    void evaluateToolAssembly(
+            const std::function<void(const CutterProfile &, float, GLfloat *, GLubyte *, GLubyte, PixelSpans *)> &evaluate,
+            GLfloat *distance, GLubyte *mask, PixelSpans &spans, size_t maxThreads = 0);
+
+    void preparePoseContext(PoseContext &context);
+
+    Pixel evaluatePoseWindow(PoseContext &context, glm::vec4 pose, glm::vec2 centre, float halfWidth, float halfHeight,
+                             float depthNear, float depthFar);
+
+    void renderToolMap();
+
+    void renderSweptToolMap(glm::vec3 from, glm::vec3 to);
+
+    float findContacts(const PixelRect &rect);
+
+    Pixel *pixelAt(long index, float depth) const;
 
 
 //Static variables
 
 public:
     long int closestPixel;
-    float scaleFactor{};
 
 
 //Constructors / Destructors
@@ -143,7 +288,8 @@ public:
             const char *title,
             int WINDOW_WIDTH, int WINDOW_HEIGHT,
             int GL_VERSION_MAJOR, int GL_VERSION_MINOR,
-            bool resizable
+            bool resizable,
+            bool visible = true
     );
 
     virtual ~Game();
@@ -151,10 +297,44 @@ public:
 //Accessors
     int getWindowShouldClose();
 
+    Tracer &getTracer();
+
+    PixelMapping pixelMapping() const;
+
+    bool needsRender() const;
+
+    std::vector<Pixel> getContactPoints() const;
+
 //Modifiers
 
     void setOrthoMatrixBounds(float left, float right, float bottom, float top);
 
+    void fitOrthoToTool();
+
+    void fitOrthoToSweep(glm::vec3 from, glm::vec3 to);
+
+    void setMapExport(export_format format, const char *prefix);
+
+    void setContactTolerance(float tolerance, size_t topK);
+
+    void setReadbackTolerance(float tolerance);
+
+    void setCutter(const Cutter &cutter);
+
+    void setToolHolder(float shankDiameter, float shankLength, float holderDiameter, float holderLength);
+
+    void addFixture(glm::vec3 min, glm::vec3 max);
+
+    void addFixtureMesh(const char *fileName);
+
+    size_t startPoseWorkers(size_t count);
+
+    void createStock(bool fromWorkpiece, float height);
+
+    void loadWorkpiece(const char *fileName);
+
+    void exportWorkpiece(const char *fileName) const;
+
 //Functions
     void updateDt();
 
@@ -168,30 +348,40 @@ public:
 
     void render();
 
-    void initialRender();
+    void warmUp();
 
     void saveDepthMap();
 
     Pixel *calculateNearestPixel();
 
+    Pixel *calculateSweptNearestPixel(glm::vec3 from, glm::vec3 to);
+
+    std::vector<Pixel> calculateTiledContacts(int tilesX, int tilesY);
+
+    std::vector<Pixel> evaluatePoses(const std::vector<glm::vec3> &poses, int refinements = 0,
+                                     float refineBelow = std::numeric_limits<float>::max());
+
     void swapTorusAndBezier();
 
+    void cutStock(const std::vector<glm::vec3> &toolpath);
+
     [[maybe_unused]] void rotateBezier();
 
     [[maybe_unused]] static GLfloat *reCalculateClosestPoint(GLfloat *);
 
 //Static functions
-    static void framebuffer_resize_callback([[maybe_unused]] GLFWwindow *window, int fbW, int fbH);
+    static void framebuffer_resize_callback(GLFWwindow *window, [[maybe_unused]] int fbW, [[maybe_unused]] int fbH);
+
+    static void window_refresh_callback(GLFWwindow *window);
 
     static void
-    changeRenderMode([[maybe_unused]] GLFWwindow *window, int key, [[maybe_unused]] int scancode, int action,
+    changeRenderMode(GLFWwindow *window, int key, [[maybe_unused]] int scancode, int action,
                      [[maybe_unused]] int mods);
 
     void recalculateDepthMap();
 
     Pixel * reCalculateNearestPixel();
 
-    void setNewScaleFactor(float tolerance);
 
 };
 
@@ -2,6 +2,9 @@
 #include "headers/generater_functions.h"
 #include "headers/vertex.h"
 #include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 template<typename T>
 std::vector<T> linspace(T a, T b, size_t N) {
     T h = (b - a) / static_cast<T>(N - 1);
@@ -23,7 +26,10 @@ int binomialCoefficient(int n, int k) {
            binomialCoefficient(n - 1, k);
 }
 
-std::vector<Vertex> generateTriangles() {
+// Quads per side of one workpiece meshlet
+const size_t BEZIER_TILE_QUADS = 15;
+
+std::vector<Vertex> generateTriangles(std::vector<Meshlet> *meshlets) {
     int divisions = 151;
     double u_min = 0.0, u_max = 1.0, v_min = 0.0, v_max = 1.0;
 
@@ -86,39 +92,58 @@ std::vector<Vertex> generateTriangles() {
         }
     }
 
+    // Quads are emitted tile by tile so each tile is one contiguous meshlet
     std::vector<Vertex> vertexArray;
+    vertexArray.reserve((divisions - 1) * (divisions - 1) * 6);
     Vertex tempVertex{};
     tempVertex.color = glm::vec3(1.f);
     tempVertex.normal = glm::vec3(1.f);
     tempVertex.texcoord = glm::vec2(0.f, 1.f);
 
-    for (size_t i = 0; i < divisions - 1; i++) {
-        for (size_t j = 0; j < divisions - 1; j++) {
-            tempVertex.position = triangle_array[j][i];
-            vertexArray.push_back(tempVertex);
-            tempVertex.position = triangle_array[j + 1][i];
-            vertexArray.push_back(tempVertex);
-            tempVertex.position = triangle_array[j + 1][i + 1];
-            vertexArray.push_back(tempVertex);
+    for (size_t tile_i = 0; tile_i < divisions - 1; tile_i += BEZIER_TILE_QUADS) {
+        for (size_t tile_j = 0; tile_j < divisions - 1; tile_j += BEZIER_TILE_QUADS) {
+            size_t first = vertexArray.size();
+
+            for (size_t i = tile_i; i < std::min(tile_i + BEZIER_TILE_QUADS, size_t(divisions - 1)); i++) {
+                for (size_t j = tile_j; j < std::min(tile_j + BEZIER_TILE_QUADS, size_t(divisions - 1)); j++) {
+                    tempVertex.position = triangle_array[j][i];
+                    vertexArray.push_back(tempVertex);
+                    tempVertex.position = triangle_array[j + 1][i];
+                    vertexArray.push_back(tempVertex);
+                    tempVertex.position = triangle_array[j + 1][i + 1];
+                    vertexArray.push_back(tempVertex);
+
+                    tempVertex.position = triangle_array[j][i];
+                    vertexArray.push_back(tempVertex);
+                    tempVertex.position = triangle_array[j + 1][i + 1];
+                    vertexArray.push_back(tempVertex);
+                    tempVertex.position = triangle_array[j][i + 1];
+                    vertexArray.push_back(tempVertex);
+                }
+            }
 
-            tempVertex.position = triangle_array[j][i];
-            vertexArray.push_back(tempVertex);
-            tempVertex.position = triangle_array[j + 1][i + 1];
-            vertexArray.push_back(tempVertex);
-            tempVertex.position = triangle_array[j][i + 1];
-            vertexArray.push_back(tempVertex);
+            if (meshlets) {
+                Meshlet meshlet{};
+                meshlet.first = GLint(first);
+                meshlet.count = GLsizei(vertexArray.size() - first);
+                computeBounds(vertexArray.data() + first, meshlet.count, meshlet.aabbMin, meshlet.aabbMax);
+                meshlets->push_back(meshlet);
+            }
         }
     }
 
     return vertexArray;
 }
 
-std::vector<Vertex> generateTorus() {
-    float radius_inner = 6.0f;
-    float radius_outer = 6.7f;
-    int theta_min = 0;
-    int theta_max = -180;
+const float TORUS_RADIUS_INNER = 6.0f;
+const float TORUS_RADIUS_OUTER = 6.7f;
+
+// Target length of a triangle edge on screen, in pixels, and the cap on divisions per axis.
+const double CUTTER_LOD_EDGE_PIXELS = 8.0;
+const long CUTTER_LOD_MAX_DIVISIONS = 1024;
 
+// Revolves (radius, z) profile points around the z axis
+static std::vector<Vertex> revolveProfile(const std::vector<glm::vec2> &profile, const std::vector<double> &phi_i) {
     glm::vec3 wt = glm::vec3(0.f, 0.f, 1.f);
     glm::vec3 ut = glm::vec3(1.f, 0.f, 0.f);
     glm::vec3 vt = glm::vec3(0.f, -1.f, 0.f);
@@ -126,51 +151,44 @@ std::vector<Vertex> generateTorus() {
 
     glm::vec3 ccc;
 
-    int div_t = 150, div_p = 150;
+    size_t div_t = profile.size(), div_p = phi_i.size();
 
-    std::vector<double> theta_a = linspace((theta_min * M_PI) / 180, (theta_max * M_PI) / 180, div_t);
-
-    double tempTheta;
     double tempPhi;
 
-    std::vector<double> phi_i;
-
-    glm::vec3 triangleVerticesArray[div_t][div_p];
+    std::vector<glm::vec3> triangleVerticesArray(div_t * div_p);
 
     for (size_t i = 0; i < div_t; i++) {
-        tempTheta = theta_a[i];
-        phi_i = linspace((double) 0, 2 * M_PI, div_p);
-
         for (size_t j = 0; j < div_p; j++) {
             tempPhi = phi_i[j];
-            ccc = ut * (float) ((radius_outer + radius_inner * cos(tempTheta)) * cos(tempPhi)) +
-                  vt * (float) ((radius_outer + radius_inner * cos(tempTheta)) * sin(tempPhi)) +
-                  wt * (float) (radius_inner * sin(tempTheta)) + tc1;
+            ccc = ut * (float) (profile[i].x * cos(tempPhi)) +
+                  vt * (float) (profile[i].x * sin(tempPhi)) +
+                  wt * profile[i].y + tc1;
 
-            triangleVerticesArray[i][j] = ccc;
+            triangleVerticesArray[i * div_p + j] = ccc;
         }
     }
 
     std::vector<Vertex> vertexArray;
+    vertexArray.reserve((div_t - 1) * (div_p - 1) * 6);
     Vertex tempVertex{};
     tempVertex.color = glm::vec3(1.f, 0.f, 0.f);
     tempVertex.normal = glm::vec3(1.f);
     tempVertex.texcoord = glm::vec2(0.f, 1.f);
 
-    for (size_t i = 0; i < div_p - 1; i++) {
-        for (size_t j = 0; j < div_t - 1; j++) {
-            tempVertex.position = triangleVerticesArray[j][i];
+    for (size_t i = 0; i + 1 < div_p; i++) {
+        for (size_t j = 0; j + 1 < div_t; j++) {
+            tempVertex.position = triangleVerticesArray[j * div_p + i];
             vertexArray.push_back(tempVertex);
-            tempVertex.position = triangleVerticesArray[j + 1][i];
+            tempVertex.position = triangleVerticesArray[(j + 1) * div_p + i];
             vertexArray.push_back(tempVertex);
-            tempVertex.position = triangleVerticesArray[j + 1][i + 1];
+            tempVertex.position = triangleVerticesArray[(j + 1) * div_p + i + 1];
             vertexArray.push_back(tempVertex);
 
-            tempVertex.position = triangleVerticesArray[j][i];
+            tempVertex.position = triangleVerticesArray[j * div_p + i];
             vertexArray.push_back(tempVertex);
-            tempVertex.position = triangleVerticesArray[j + 1][i + 1];
+            tempVertex.position = triangleVerticesArray[(j + 1) * div_p + i + 1];
             vertexArray.push_back(tempVertex);
-            tempVertex.position = triangleVerticesArray[j][i + 1];
+            tempVertex.position = triangleVerticesArray[j * div_p + i + 1];
             vertexArray.push_back(tempVertex);
         }
     }
@@ -178,6 +196,323 @@ std::vector<Vertex> generateTorus() {
     return vertexArray;
 }
 
+static double cutterProfileStep(int level) {
+    return CUTTER_LOD_EDGE_PIXELS * std::ldexp(1.0, level);
+}
+
+static double cutterPhiStep(const CutterProfile &profile, int level) {
+    return cutterProfileStep(level) / std::max(double(profile.getSilhouetteRadius()), 1e-3);
+}
+
+std::vector<Vertex> generateTorus() {
+    int theta_min = 0;
+    int theta_max = -180;
+
+    int div_t = 150, div_p = 150;
+
+    std::vector<double> theta_a = linspace((theta_min * M_PI) / 180, (theta_max * M_PI) / 180, div_t);
+    std::vector<double> phi_i = linspace((double) 0, 2 * M_PI, div_p);
+
+    std::vector<glm::vec2> profile;
+    for (double theta : theta_a)
+        profile.emplace_back(TORUS_RADIUS_OUTER + TORUS_RADIUS_INNER * cos(theta), TORUS_RADIUS_INNER * sin(theta));
+
+    return revolveProfile(profile, phi_i);
+}
+
+std::vector<Vertex> generateCutter(const CutterProfile &profile, const CutterLod &lod) {
+    double profile_step = cutterProfileStep(lod.level);
+    double phi_step = cutterPhiStep(profile, lod.level);
+
+    // Grid samples plus the segment joints inside the range, so corners are not cut
+    double s_first = std::clamp(double(lod.profile_first) * profile_step, 0.0, double(profile.getLength()));
+    double s_last = std::clamp(double(lod.profile_last) * profile_step, 0.0, double(profile.getLength()));
+
+    std::vector<double> s_i;
+    for (long k = lod.profile_first; k <= lod.profile_last; k++)
+        s_i.push_back(std::clamp(double(k) * profile_step, s_first, s_last));
+    for (float breakpoint : profile.getBreakpoints())
+        if (breakpoint > s_first && breakpoint < s_last)
+            s_i.push_back(breakpoint);
+
+    std::sort(s_i.begin(), s_i.end());
+    s_i.erase(std::unique(s_i.begin(), s_i.end()), s_i.end());
+
+    std::vector<glm::vec2> points;
+    for (double s : s_i)
+        points.push_back(profile.point(float(s)));
+
+    // A full turn is closed exactly at 2*pi instead of overshooting to the next grid sample
+    std::vector<double> phi_i;
+    double phi_end = double(lod.phi_first) * phi_step + 2 * M_PI;
+    for (long k = lod.phi_first; k <= lod.phi_last; k++)
+        phi_i.push_back(std::min(double(k) * phi_step, phi_end));
+
+    return revolveProfile(points, phi_i);
+}
+
+CutterLod selectCutterLod(const CutterProfile &profile, float left, float right, float bottom, float top,
+                          int width, int height, glm::vec2 cutterCenter, bool crop) {
+    double pixel = std::max(double(right - left) / width, double(top - bottom) / height);
+
+    // Window relative to the cutter axis, grown by a couple of pixels so edge samples are never clipped
+    double x0 = left - cutterCenter.x - 2 * pixel, x1 = right - cutterCenter.x + 2 * pixel;
+    double y0 = bottom - cutterCenter.y - 2 * pixel, y1 = top - cutterCenter.y + 2 * pixel;
+
+    // Radial extent of the window
+    double nearest_x = std::clamp(0.0, x0, x1), nearest_y = std::clamp(0.0, y0, y1);
+    double rho_min = std::hypot(nearest_x, nearest_y);
+    double rho_max = std::max(std::hypot(x0, y0), std::max(std::hypot(x0, y1),
+                                                           std::max(std::hypot(x1, y0), std::hypot(x1, y1))));
+
+    // Angular extent of the window, phi measured the way revolveProfile sweeps it (vt = -y)
+    bool full_turn = !crop || (x0 <= 0 && x1 >= 0 && y0 <= 0 && y1 >= 0);
+    double phi_lo = 0, phi_hi = 2 * M_PI;
+    if (!full_turn) {
+        double corners[4][2] = {{x0, y0}, {x0, y1}, {x1, y0}, {x1, y1}};
+        double reference = atan2(-corners[0][1], corners[0][0]);
+        double delta_min = 0, delta_max = 0;
+        for (auto &corner : corners) {
+            double delta = remainder(atan2(-corner[1], corner[0]) - reference, 2 * M_PI);
+            delta_min = std::min(delta_min, delta);
+            delta_max = std::max(delta_max, delta);
+        }
+        phi_lo = reference + delta_min;
+        phi_hi = reference + delta_max;
+        if (phi_lo < 0) {
+            phi_lo += 2 * M_PI;
+            phi_hi += 2 * M_PI;
+        }
+    }
+
+    // Radius never decreases along the profile, so the radial extent maps to one arc-length range
+    double s_lo = crop ? profile.arcAtRadius(float(rho_min), false) : 0.0;
+    double s_hi = crop ? profile.arcAtRadius(float(rho_max), true) : double(profile.getLength());
+
+    CutterLod lod{};
+    lod.level = int(std::floor(std::log2(pixel)));
+
+    while (true) {
+        double profile_step = cutterProfileStep(lod.level);
+        double phi_step = cutterPhiStep(profile, lod.level);
+
+        lod.profile_first = std::max(long(std::floor(s_lo / profile_step)), 0L);
+        lod.profile_last = std::min(long(std::ceil(s_hi / profile_step)),
+                                    long(std::ceil(profile.getLength() / profile_step)));
+        lod.phi_first = long(std::floor(phi_lo / phi_step));
+        lod.phi_last = long(std::ceil(phi_hi / phi_step));
+
+        if (lod.profile_last - lod.profile_first < 1)
+            lod.profile_last = lod.profile_first + 1;
+
+        if (lod.profile_last - lod.profile_first < CUTTER_LOD_MAX_DIVISIONS &&
+            lod.phi_last - lod.phi_first < CUTTER_LOD_MAX_DIVISIONS)
+            break;
+
+        lod.level++;
+    }
+
+    return lod;
+}
+
 // Equation
 
 // (x - 52.5)*150/375,
+
+// Quads per side of one stock meshlet
+const int ZMAP_TILE_QUADS = 32;
+
+// Indexed grid through the cell centres of a Z-map, in world space. Vertices are shared between
+// tiles; each tile of quads is one contiguous range of indices.
+void generateZMapMesh(const ZMap &zmap, std::vector<Vertex> &vertices, std::vector<GLuint> &indices,
+                      std::vector<Meshlet> *meshlets) {
+    const int width = zmap.getWidth();
+    const int height = zmap.getHeight();
+
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(size_t(width) * height);
+    indices.reserve(size_t(std::max(width - 1, 0)) * std::max(height - 1, 0) * 6);
+
+    Vertex tempVertex{};
+    tempVertex.color = glm::vec3(1.f);
+    tempVertex.normal = glm::vec3(1.f);
+    tempVertex.texcoord = glm::vec2(0.f, 1.f);
+
+    for (int row = 0; row < height; row++) {
+        for (int column = 0; column < width; column++) {
+            tempVertex.position = zmap.cellPoint(column, row);
+            vertices.push_back(tempVertex);
+        }
+    }
+
+    for (int tile_r = 0; tile_r < height - 1; tile_r += ZMAP_TILE_QUADS) {
+        for (int tile_c = 0; tile_c < width - 1; tile_c += ZMAP_TILE_QUADS) {
+            size_t first = indices.size();
+            int rowLast = std::min(tile_r + ZMAP_TILE_QUADS, height - 1);
+            int columnLast = std::min(tile_c + ZMAP_TILE_QUADS, width - 1);
+
+            glm::vec3 aabbMin = vertices[size_t(tile_r) * width + tile_c].position;
+            glm::vec3 aabbMax = aabbMin;
+
+            for (int row = tile_r; row < rowLast; row++) {
+                for (int column = tile_c; column < columnLast; column++) {
+                    GLuint i = GLuint(row * width + column);
+
+                    indices.push_back(i);
+                    indices.push_back(i + 1);
+                    indices.push_back(i + width + 1);
+
+                    indices.push_back(i);
+                    indices.push_back(i + width + 1);
+                    indices.push_back(i + width);
+                }
+            }
+
+            for (int row = tile_r; row <= rowLast; row++) {
+                for (int column = tile_c; column <= columnLast; column++) {
+                    aabbMin = glm::min(aabbMin, vertices[size_t(row) * width + column].position);
+                    aabbMax = glm::max(aabbMax, vertices[size_t(row) * width + column].position);
+                }
+            }
+
+            if (meshlets) {
+                Meshlet meshlet{};
+                meshlet.first = GLint(first);
+                meshlet.count = GLsizei(indices.size() - first);
+                meshlet.aabbMin = aabbMin;
+                meshlet.aabbMax = aabbMax;
+                meshlets->push_back(meshlet);
+            }
+        }
+    }
+}
+
+// Target length of a workpiece triangle edge in world units, and the cap on quads per patch side
+const float NURBS_EDGE_LENGTH = 1.0f;
+const int NURBS_MAX_DIVISIONS = 256;
+
+// Quads per side of one NURBS meshlet
+const int NURBS_TILE_QUADS = 16;
+
+// Where one patch goes in the shared buffers
+struct NurbsPatchLayout {
+    int divisionsU;
+    int divisionsV;
+    size_t firstVertex;
+    size_t firstIndex;
+    size_t firstMeshlet;
+};
+
+// Indexed mesh of all patches in model space. Each patch is a regular grid in its parameter range,
+// dense enough that edges are about NURBS_EDGE_LENGTH along the control polygon. Buffer offsets are
+// laid out first, so the patches are then tessellated in parallel straight into the shared buffers.
+void generateNurbsMesh(const std::vector<NurbsPatch> &patches, std::vector<Vertex> &vertices,
+                       std::vector<GLuint> &indices, std::vector<Meshlet> *meshlets) {
+    std::vector<NurbsPatchLayout> layouts(patches.size());
+    size_t vertexCount = 0, indexCount = 0, meshletCount = 0;
+
+    for (size_t p = 0; p < patches.size(); p++) {
+        NurbsPatchLayout &layout = layouts[p];
+        layout.divisionsU = std::clamp(int(std::ceil(controlPolygonLength(patches[p], true) / NURBS_EDGE_LENGTH)),
+                                       1, NURBS_MAX_DIVISIONS);
+        layout.divisionsV = std::clamp(int(std::ceil(controlPolygonLength(patches[p], false) / NURBS_EDGE_LENGTH)),
+                                       1, NURBS_MAX_DIVISIONS);
+        layout.firstVertex = vertexCount;
+        layout.firstIndex = indexCount;
+        layout.firstMeshlet = meshletCount;
+
+        vertexCount += size_t(layout.divisionsU + 1) * (layout.divisionsV + 1);
+        indexCount += size_t(layout.divisionsU) * layout.divisionsV * 6;
+        meshletCount += size_t((layout.divisionsU + NURBS_TILE_QUADS - 1) / NURBS_TILE_QUADS) *
+                        ((layout.divisionsV + NURBS_TILE_QUADS - 1) / NURBS_TILE_QUADS);
+    }
+
+    vertices.resize(vertexCount);
+    indices.resize(indexCount);
+    std::vector<Meshlet> tiles(meshletCount);
+
+    auto tessellate = [&](size_t p) {
+        const NurbsPatch &patch = patches[p];
+        const NurbsPatchLayout &layout = layouts[p];
+        const int columns = layout.divisionsV + 1;
+
+        NurbsBasisLine lineU(patch.knotsU, patch.degreeU, patch.countU, layout.divisionsU);
+        NurbsBasisLine lineV(patch.knotsV, patch.degreeV, patch.countV, layout.divisionsV);
+
+        Vertex tempVertex{};
+        tempVertex.color = glm::vec3(1.f);
+        tempVertex.normal = glm::vec3(1.f);
+        tempVertex.texcoord = glm::vec2(0.f, 1.f);
+
+        Vertex *patchVertices = vertices.data() + layout.firstVertex;
+        for (int k = 0; k <= layout.divisionsU; k++) {
+            for (int l = 0; l <= layout.divisionsV; l++) {
+                tempVertex.position = evaluateNurbsPoint(patch, lineU, k, lineV, l);
+                patchVertices[size_t(k) * columns + l] = tempVertex;
+            }
+        }
+
+        GLuint *index = indices.data() + layout.firstIndex;
+        Meshlet *tile = tiles.data() + layout.firstMeshlet;
+
+        for (int tile_u = 0; tile_u < layout.divisionsU; tile_u += NURBS_TILE_QUADS) {
+            for (int tile_v = 0; tile_v < layout.divisionsV; tile_v += NURBS_TILE_QUADS) {
+                GLuint *first = index;
+                int rowLast = std::min(tile_u + NURBS_TILE_QUADS, layout.divisionsU);
+                int columnLast = std::min(tile_v + NURBS_TILE_QUADS, layout.divisionsV);
+
+                glm::vec3 aabbMin = patchVertices[size_t(tile_u) * columns + tile_v].position;
+                glm::vec3 aabbMax = aabbMin;
+
+                for (int row = tile_u; row < rowLast; row++) {
+                    for (int column = tile_v; column < columnLast; column++) {
+                        GLuint i = GLuint(layout.firstVertex + size_t(row) * columns + column);
+
+                        *index++ = i;
+                        *index++ = i + columns;
+                        *index++ = i + columns + 1;
+
+                        *index++ = i;
+                        *index++ = i + columns + 1;
+                        *index++ = i + 1;
+                    }
+                }
+
+                for (int row = tile_u; row <= rowLast; row++) {
+                    for (int column = tile_v; column <= columnLast; column++) {
+                        aabbMin = glm::min(aabbMin, patchVertices[size_t(row) * columns + column].position);
+                        aabbMax = glm::max(aabbMax, patchVertices[size_t(row) * columns + column].position);
+                    }
+                }
+
+                tile->first = GLint(first - indices.data());
+                tile->count = GLsizei(index - first);
+                tile->aabbMin = aabbMin;
+                tile->aabbMax = aabbMax;
+                tile++;
+            }
+        }
+    };
+
+    //Patches differ in size, so workers take the next patch as they finish instead of fixed shares
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t p = next++; p < patches.size(); p = next++)
+            tessellate(p);
+    };
+
+    size_t threads = std::max(size_t(1), std::min(size_t(std::thread::hardware_concurrency()), patches.size()));
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (auto &thread : workers)
+        thread.join();
+
+    if (meshlets)
+        meshlets->insert(meshlets->end(), tiles.begin(), tiles.end());
+}
@@ -0,0 +1,473 @@
+#ifndef OPENGL_5_AXIS_CONTACT_H
+#define OPENGL_5_AXIS_CONTACT_H
+
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/vec2.hpp>
+
+// View distance stored for pixels no surface was drawn into
+const float DEPTH_BACKGROUND = 100.f;
+
+// Body IDs written to the coverage attachment; 0 is background. Tool bodies and obstacles are drawn
+// in separate passes, so the two ranges share values. Fixture k has ID BODY_FIXTURE + k.
+enum tool_body_enum {
+    BODY_CUTTER = 1,
+    BODY_SHANK,
+    BODY_HOLDER
+};
+enum obstacle_body_enum {
+    BODY_WORKPIECE = 1,
+    BODY_FIXTURE
+};
+
+// Below this many pixels per thread the reduction stays on the calling thread
+const size_t CONTACT_MIN_PIXELS_PER_THREAD = 1 << 16;
+
+struct ContactCandidate {
+    long index;
+    float clearance;
+};
+
+// Occupied part of a width x height map: the rows [rowFirst, rowLast) that may hold covered pixels and,
+// per row, the columns [first, last) containing every covered pixel of that row (first == last when
+// the row has none). Pixels outside are background, so reductions and scans only walk the spans.
+// The maps themselves stay dense, as GL reads them back and the exporters write them.
+struct PixelSpans {
+    int width = 0;
+    int height = 0;
+    int rowFirst = 0;
+    int rowLast = 0;
+    std::vector<int> first;
+    std::vector<int> last;
+
+    bool empty() const {
+        return this->rowFirst >= this->rowLast;
+    }
+
+    size_t pixelCount() const {
+        size_t count = 0;
+        for (int row = this->rowFirst; row < this->rowLast; row++)
+            count += size_t(this->last[row] - this->first[row]);
+        return count;
+    }
+};
+
+// Pixels [x, x + width) x [y, y + height) of a map, rows bottom first
+struct PixelRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool empty() const {
+        return this->width <= 0 || this->height <= 0;
+    }
+};
+
+// A connected group of candidate pixels (8-neighbourhood); index/clearance are its closest pixel
+struct ContactRegion {
+    long index;
+    float clearance;
+    long pixelCount;
+};
+
+// Smallest workpiece - tool clearance over the pixels the tool covers (toolMask != 0).
+// index is left untouched when no pixel is covered.
+static float findNearestClearance(const GLfloat *workpiece, const GLfloat *tool, const GLubyte *toolMask,
+                                  const size_t nrOfPixels, long &index) {
+    float minValue = 10000.f;
+
+    for (size_t i = 0; i < nrOfPixels; i++) {
+        if (toolMask[i] && (workpiece[i] - tool[i]) < minValue) {
+            minValue = (workpiece[i] - tool[i]);
+            index = long(i);
+        }
+    }
+
+    return minValue;
+}
+
+static PixelSpans emptySpans(int width, int height) {
+    PixelSpans spans;
+    spans.width = width;
+    spans.height = height;
+    spans.first.assign(size_t(height), 0);
+    spans.last.assign(size_t(height), 0);
+    return spans;
+}
+
+static PixelSpans fullSpans(int width, int height) {
+    PixelSpans spans = emptySpans(width, height);
+    spans.rowLast = height;
+    std::fill(spans.last.begin(), spans.last.end(), width);
+    return spans;
+}
+
+// Spans of the pixels with mask != 0, for maps that were rendered. Each row is scanned inward from
+// both ends, so only empty rows are walked in full.
+static PixelSpans maskSpans(const GLubyte *mask, int width, int height) {
+    PixelSpans spans = emptySpans(width, height);
+    spans.rowFirst = height;
+
+    for (int row = 0; row < height; row++) {
+        const GLubyte *line = mask + size_t(row) * width;
+
+        int first = 0;
+        while (first < width && !line[first])
+            first++;
+
+        if (first == width)
+            continue;
+
+        int last = width;
+        while (!line[last - 1])
+            last--;
+
+        spans.first[row] = first;
+        spans.last[row] = last;
+        spans.rowFirst = std::min(spans.rowFirst, row);
+        spans.rowLast = row + 1;
+    }
+
+    if (spans.rowLast == 0)
+        spans.rowFirst = 0;
+
+    return spans;
+}
+
+// Spans of the pixels whose centres lie in the view-space rectangle, grown by one pixel so rounding
+// never drops a covered pixel; left/right/bottom/top are the map's ortho bounds
+static PixelSpans rectangleSpans(glm::vec2 min, glm::vec2 max, float left, float right, float bottom, float top,
+                                 int width, int height) {
+    PixelSpans spans = emptySpans(width, height);
+
+    float pixelWidth = (right - left) / float(width);
+    float pixelHeight = (top - bottom) / float(height);
+
+    int columnFirst = std::max(0, int(std::floor((min.x - left) / pixelWidth - 0.5f)));
+    int columnLast = std::min(width, int(std::floor((max.x - left) / pixelWidth - 0.5f)) + 2);
+    int rowFirst = std::max(0, int(std::floor((min.y - bottom) / pixelHeight - 0.5f)));
+    int rowLast = std::min(height, int(std::floor((max.y - bottom) / pixelHeight - 0.5f)) + 2);
+
+    if (columnFirst >= columnLast || rowFirst >= rowLast)
+        return spans;
+
+    spans.rowFirst = rowFirst;
+    spans.rowLast = rowLast;
+    for (int row = rowFirst; row < rowLast; row++) {
+        spans.first[row] = columnFirst;
+        spans.last[row] = columnLast;
+    }
+
+    return spans;
+}
+
+// Spans of the pixels whose centres lie in the disc, grown by one pixel like rectangleSpans
+static PixelSpans discSpans(glm::vec2 centre, float radius, float left, float right, float bottom, float top,
+                            int width, int height) {
+    PixelSpans spans = rectangleSpans(centre - glm::vec2(radius), centre + glm::vec2(radius),
+                                      left, right, bottom, top, width, height);
+
+    float pixelWidth = (right - left) / float(width);
+    float pixelHeight = (top - bottom) / float(height);
+
+    for (int row = spans.rowFirst; row < spans.rowLast; row++) {
+        //Nearest point of the row's pixel band to the centre
+        float y = std::clamp(centre.y, bottom + float(row) * pixelHeight, bottom + float(row + 1) * pixelHeight);
+        float halfWidth = std::sqrt(std::max(0.f, radius * radius - (y - centre.y) * (y - centre.y)));
+
+        spans.first[row] = std::max(spans.first[row],
+                                    int(std::floor((centre.x - halfWidth - left) / pixelWidth - 0.5f)));
+        spans.last[row] = std::max(spans.first[row], std::min(spans.last[row],
+                                   int(std::floor((centre.x + halfWidth - left) / pixelWidth - 0.5f)) + 2));
+    }
+
+    return spans;
+}
+
+// Grows spans to cover other as well; both describe maps of the same size
+static void uniteSpans(PixelSpans &spans, const PixelSpans &other) {
+    if (other.empty())
+        return;
+
+    if (spans.empty()) {
+        spans = other;
+        return;
+    }
+
+    for (int row = other.rowFirst; row < other.rowLast; row++) {
+        if (other.first[row] == other.last[row])
+            continue;
+
+        if (spans.first[row] == spans.last[row]) {
+            spans.first[row] = other.first[row];
+            spans.last[row] = other.last[row];
+        } else {
+            spans.first[row] = std::min(spans.first[row], other.first[row]);
+            spans.last[row] = std::max(spans.last[row], other.last[row]);
+        }
+    }
+
+    spans.rowFirst = std::min(spans.rowFirst, other.rowFirst);
+    spans.rowLast = std::max(spans.rowLast, other.rowLast);
+}
+
+static PixelRect intersectRects(const PixelRect &a, const PixelRect &b) {
+    PixelRect rect;
+    rect.x = std::max(a.x, b.x);
+    rect.y = std::max(a.y, b.y);
+    rect.width = std::max(0, std::min(a.x + a.width, b.x + b.width) - rect.x);
+    rect.height = std::max(0, std::min(a.y + a.height, b.y + b.height) - rect.y);
+    return rect;
+}
+
+// Smallest rectangle holding every span
+static PixelRect spansBounds(const PixelSpans &spans) {
+    PixelRect rect;
+    int columnFirst = spans.width, columnLast = 0;
+
+    for (int row = spans.rowFirst; row < spans.rowLast; row++) {
+        if (spans.first[row] == spans.last[row])
+            continue;
+
+        columnFirst = std::min(columnFirst, spans.first[row]);
+        columnLast = std::max(columnLast, spans.last[row]);
+    }
+
+    if (columnFirst >= columnLast)
+        return rect;
+
+    rect.x = columnFirst;
+    rect.y = spans.rowFirst;
+    rect.width = columnLast - columnFirst;
+    rect.height = spans.rowLast - spans.rowFirst;
+    return rect;
+}
+
+// The part of spans inside rect
+static PixelSpans clipSpans(const PixelSpans &spans, const PixelRect &rect) {
+    PixelSpans clipped = emptySpans(spans.width, spans.height);
+
+    int rowFirst = std::max(spans.rowFirst, rect.y);
+    int rowLast = std::min(spans.rowLast, rect.y + rect.height);
+    if (rowFirst >= rowLast || rect.empty())
+        return clipped;
+
+    clipped.rowFirst = rowFirst;
+    clipped.rowLast = rowLast;
+    for (int row = rowFirst; row < rowLast; row++) {
+        clipped.first[row] = std::clamp(spans.first[row], rect.x, rect.x + rect.width);
+        clipped.last[row] = std::clamp(spans.last[row], clipped.first[row], rect.x + rect.width);
+    }
+
+    return clipped;
+}
+
+// findNearestClearance over the spans of a width-wide map only
+static float findNearestClearance(const GLfloat *workpiece, const GLfloat *tool, const GLubyte *toolMask,
+                                  const PixelSpans &spans, long &index) {
+    float minValue = 10000.f;
+
+    for (int row = spans.rowFirst; row < spans.rowLast; row++) {
+        size_t rowStart = size_t(row) * spans.width;
+
+        for (size_t i = rowStart + spans.first[row]; i < rowStart + spans.last[row]; i++) {
+            if (toolMask[i] && (workpiece[i] - tool[i]) < minValue) {
+                minValue = (workpiece[i] - tool[i]);
+                index = long(i);
+            }
+        }
+    }
+
+    return minValue;
+}
+
+static bool operator<(const ContactCandidate &a, const ContactCandidate &b) {
+    return a.clearance < b.clearance || (a.clearance == b.clearance && a.index < b.index);
+}
+
+// Runs work(first, last) over [0, nrOfPixels) split into contiguous chunks, one per thread
+template<typename Work>
+static void forEachPixelChunk(size_t nrOfPixels, Work work) {
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                      std::max<size_t>(1, nrOfPixels / CONTACT_MIN_PIXELS_PER_THREAD));
+    size_t chunk = (nrOfPixels + threads - 1) / threads;
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+        workers.emplace_back(work, t, std::min(t * chunk, nrOfPixels), std::min((t + 1) * chunk, nrOfPixels));
+
+    work(0, 0, std::min(chunk, nrOfPixels));
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// Runs work(rowFirst, rowLast) over the occupied rows of spans split into contiguous chunks, one per
+// thread; the thread count follows the occupied pixel count, not the map size. maxThreads caps it
+// (0 for the hardware concurrency); callers already running on a worker thread pass 1.
+template<typename Work>
+static void forEachSpanChunk(const PixelSpans &spans, Work work, size_t maxThreads = 0) {
+    size_t rows = size_t(std::max(0, spans.rowLast - spans.rowFirst));
+    size_t threads = std::min<size_t>(maxThreads ? maxThreads : std::max(1u, std::thread::hardware_concurrency()),
+                                      std::max<size_t>(1, spans.pixelCount() / CONTACT_MIN_PIXELS_PER_THREAD));
+    threads = std::max<size_t>(1, std::min(threads, rows));
+    size_t chunk = (rows + threads - 1) / threads;
+
+    auto rowAt = [&](size_t offset) { return spans.rowFirst + int(std::min(offset, rows)); };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+        workers.emplace_back(work, t, rowAt(t * chunk), rowAt((t + 1) * chunk));
+
+    work(0, rowAt(0), rowAt(chunk));
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// Keeps only the k smallest candidates (k == 0 keeps all), sorted by clearance
+static void selectSmallest(std::vector<ContactCandidate> &candidates, size_t k) {
+    if (k != 0 && candidates.size() > k) {
+        std::nth_element(candidates.begin(), candidates.begin() + long(k), candidates.end());
+        candidates.resize(k);
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+}
+
+// Every covered pixel whose clearance is within tolerance of the minimum, limited to the k
+// smallest (k == 0 for no limit). The minimum and the partial selection both run in parallel
+// over pixel chunks; each chunk pre-selects its own k before the results are merged.
+static std::vector<ContactCandidate> findContactCandidates(const GLfloat *workpiece, const GLfloat *tool,
+                                                           const GLubyte *toolMask, const size_t nrOfPixels,
+                                                           const size_t k, const float tolerance) {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<float> chunkMin(threads, 10000.f);
+
+    forEachPixelChunk(nrOfPixels, [&](size_t t, size_t first, size_t last) {
+        long index = 0;
+        chunkMin[t] = findNearestClearance(workpiece + first, tool + first, toolMask + first, last - first, index);
+    });
+
+    float threshold = *std::min_element(chunkMin.begin(), chunkMin.end()) + tolerance;
+    std::vector<std::vector<ContactCandidate>> chunkCandidates(threads);
+
+    forEachPixelChunk(nrOfPixels, [&](size_t t, size_t first, size_t last) {
+        std::vector<ContactCandidate> &local = chunkCandidates[t];
+
+        for (size_t i = first; i < last; i++) {
+            float clearance = workpiece[i] - tool[i];
+            if (toolMask[i] && clearance <= threshold)
+                local.push_back({long(i), clearance});
+        }
+
+        selectSmallest(local, k);
+    });
+
+    std::vector<ContactCandidate> candidates;
+    for (auto &local : chunkCandidates)
+        candidates.insert(candidates.end(), local.begin(), local.end());
+
+    selectSmallest(candidates, k);
+    return candidates;
+}
+
+// findContactCandidates over the spans of a width-wide map only; indices are into the whole map
+static std::vector<ContactCandidate> findContactCandidates(const GLfloat *workpiece, const GLfloat *tool,
+                                                           const GLubyte *toolMask, const PixelSpans &spans,
+                                                           const size_t k, const float tolerance) {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<float> chunkMin(threads, 10000.f);
+
+    auto forEachSpan = [&](int rowFirst, int rowLast, auto visit) {
+        for (int row = rowFirst; row < rowLast; row++) {
+            size_t rowStart = size_t(row) * spans.width;
+            for (size_t i = rowStart + spans.first[row]; i < rowStart + spans.last[row]; i++)
+                if (toolMask[i])
+                    visit(i, workpiece[i] - tool[i]);
+        }
+    };
+
+    forEachSpanChunk(spans, [&](size_t t, int rowFirst, int rowLast) {
+        float &minValue = chunkMin[t];
+        forEachSpan(rowFirst, rowLast, [&](size_t, float clearance) { minValue = std::min(minValue, clearance); });
+    });
+
+    float threshold = *std::min_element(chunkMin.begin(), chunkMin.end()) + tolerance;
+    std::vector<std::vector<ContactCandidate>> chunkCandidates(threads);
+
+    forEachSpanChunk(spans, [&](size_t t, int rowFirst, int rowLast) {
+        std::vector<ContactCandidate> &local = chunkCandidates[t];
+
+        forEachSpan(rowFirst, rowLast, [&](size_t i, float clearance) {
+            if (clearance <= threshold)
+                local.push_back({long(i), clearance});
+        });
+
+        selectSmallest(local, k);
+    });
+
+    std::vector<ContactCandidate> candidates;
+    for (auto &local : chunkCandidates)
+        candidates.insert(candidates.end(), local.begin(), local.end());
+
+    selectSmallest(candidates, k);
+    return candidates;
+}
+
+// Groups candidates (row-major indices into a width-wide image) into 8-connected regions,
+// ordered by their closest clearance
+static std::vector<ContactRegion> clusterContactCandidates(const std::vector<ContactCandidate> &candidates,
+                                                           const long width) {
+    std::unordered_map<long, size_t> slot;
+    for (size_t i = 0; i < candidates.size(); i++)
+        slot[candidates[i].index] = i;
+
+    std::vector<ContactRegion> regions;
+    std::vector<bool> visited(candidates.size(), false);
+    std::vector<size_t> stack;
+
+    //Candidates are sorted, so the first pixel of each region is its closest one
+    for (size_t seed = 0; seed < candidates.size(); seed++) {
+        if (visited[seed])
+            continue;
+
+        ContactRegion region{candidates[seed].index, candidates[seed].clearance, 0};
+        visited[seed] = true;
+        stack.push_back(seed);
+
+        while (!stack.empty()) {
+            long index = candidates[stack.back()].index;
+            stack.pop_back();
+            region.pixelCount++;
+
+            long row = index / width, column = index % width;
+
+            for (long dy = -1; dy <= 1; dy++) {
+                for (long dx = -1; dx <= 1; dx++) {
+                    if (column + dx < 0 || column + dx >= width)
+                        continue;
+
+                    auto neighbour = slot.find((row + dy) * width + column + dx);
+                    if (neighbour != slot.end() && !visited[neighbour->second]) {
+                        visited[neighbour->second] = true;
+                        stack.push_back(neighbour->second);
+                    }
+                }
+            }
+        }
+
+        regions.push_back(region);
+    }
+
+    return regions;
+}
+
+#endif //OPENGL_5_AXIS_CONTACT_H
@@ -0,0 +1,126 @@
+#ifndef OPENGL_5_AXIS_CONTEXTPOOL_H
+#define OPENGL_5_AXIS_CONTEXTPOOL_H
+
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// Worker threads that each own a hidden GLFW window, whose context shares buffers, renderbuffers,
+// textures and programs with the main context. Container objects (VAOs, FBOs) are not shared, so
+// every worker keeps its own. Windows are created and destroyed on the main thread, as GLFW requires.
+class ContextPool {
+private:
+    std::vector<GLFWwindow *> windows;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    std::function<void(size_t)> job;
+    size_t generation;
+    size_t running;
+    bool stopping;
+
+    void workerLoop(size_t worker) {
+        glfwMakeContextCurrent(this->windows[worker]);
+
+        size_t seen = 0;
+
+        for (;;) {
+            std::function<void(size_t)> current;
+
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wake.wait(lock, [&] { return this->stopping || this->generation != seen; });
+
+                if (this->stopping)
+                    break;
+
+                seen = this->generation;
+                current = this->job;
+            }
+
+            current(worker);
+
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (--this->running == 0)
+                    this->finished.notify_all();
+            }
+        }
+
+        glfwMakeContextCurrent(nullptr);
+    }
+
+public:
+    // Uses the context hints of the last window created, so workers get the same GL version and profile
+    ContextPool(GLFWwindow *shared, size_t workers) : generation(0), running(0), stopping(false) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        for (size_t i = 0; i < workers; i++) {
+            GLFWwindow *window = glfwCreateWindow(1, 1, "worker", nullptr, shared);
+
+            if (window == nullptr) {
+                std::cout << "ERROR::CONTEXTPOOL::WINDOW_INIT_FAILED"
+                          << "\n";
+                break;
+            }
+
+            this->windows.push_back(window);
+        }
+
+        for (size_t i = 0; i < this->windows.size(); i++)
+            this->threads.emplace_back(&ContextPool::workerLoop, this, i);
+    }
+
+    ~ContextPool() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+
+        for (auto &thread : this->threads)
+            thread.join();
+
+        for (auto &window : this->windows)
+            glfwDestroyWindow(window);
+    }
+
+    ContextPool(const ContextPool &) = delete;
+
+    ContextPool &operator=(const ContextPool &) = delete;
+
+    //Accessors
+    size_t size() const {
+        return this->windows.size();
+    }
+
+    //Functions
+
+    // Runs job(worker) once on every worker, with the worker's context current, and waits for all
+    // of them. Objects the caller created must be flushed (glFinish) before they are used here.
+    void run(const std::function<void(size_t)> &work) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+
+        if (this->windows.empty())
+            return;
+
+        this->job = work;
+        this->running = this->windows.size();
+        this->generation++;
+        this->wake.notify_all();
+
+        this->finished.wait(lock, [&] { return this->running == 0; });
+    }
+};
+
+#endif //OPENGL_5_AXIS_CONTEXTPOOL_H
@@ -0,0 +1,409 @@
+#ifndef OPENGL_5_AXIS_CUTTER_H
+#define OPENGL_5_AXIS_CUTTER_H
+
+
+#include <vector>
+#include <tuple>
+#include <cmath>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/vec2.hpp>
+
+#include "contact.h"
+
+enum cutter_type {
+    CUTTER_TORUS = 0,
+    CUTTER_BALL,
+    CUTTER_FLAT,
+    CUTTER_BULL_NOSE,
+    CUTTER_APT
+};
+
+// APT 7-parameter cutter: diameter d, corner radius r, corner centre at radius e and height f,
+// bottom angle alpha and side taper beta (degrees), height h. The tip is at the origin and the
+// cutter extends along +z. CUTTER_TORUS is the original tool: the lower half of a torus with
+// tube radius r around a ring of radius e, centred on the origin.
+struct Cutter {
+    cutter_type type;
+    float d, r, e, f, alpha, beta, h;
+
+    bool operator<(const Cutter &other) const {
+        return std::tie(type, d, r, e, f, alpha, beta, h) <
+               std::tie(other.type, other.d, other.r, other.e, other.f, other.alpha, other.beta, other.h);
+    }
+
+    static Cutter torus() {
+        return Cutter{CUTTER_TORUS, 2 * (6.7f + 6.0f), 6.0f, 6.7f, 0.f, 0.f, 0.f, 0.f};
+    }
+
+    static Cutter ball(float d, float h) {
+        return Cutter{CUTTER_BALL, d, d / 2, 0.f, d / 2, 0.f, 0.f, h};
+    }
+
+    static Cutter flat(float d, float h) {
+        return Cutter{CUTTER_FLAT, d, 0.f, d / 2, 0.f, 0.f, 0.f, h};
+    }
+
+    static Cutter bullNose(float d, float r, float h) {
+        return Cutter{CUTTER_BULL_NOSE, d, r, d / 2 - r, r, 0.f, 0.f, h};
+    }
+
+    static Cutter apt(float d, float r, float e, float f, float alpha, float beta, float h) {
+        return Cutter{CUTTER_APT, d, r, e, f, alpha, beta, h};
+    }
+};
+
+// One body of a tool assembly: a solid of revolution with the same axis as the cutter, its tip
+// offset along the axis from the cutter tip. Shanks and holders are cylinders (flat cutters).
+struct ToolBody {
+    Cutter cutter;
+    float offset;
+
+    bool operator<(const ToolBody &other) const {
+        return std::tie(cutter, offset) < std::tie(other.cutter, other.offset);
+    }
+};
+
+// One line or circular arc of a profile, in (radius, z)
+struct ProfileSegment {
+    bool arc;
+    glm::vec2 start;
+    glm::vec2 end;
+    glm::vec2 centre;
+    float radius;
+    float angleStart;
+    float angleEnd;
+    float arcStart;
+    float length;
+};
+
+// Cutting profile in the (radius, z) half plane, from the axis side outwards. The tool surface is
+// this profile revolved around z; radius never decreases along it, so every radius inside the
+// footprint has exactly one lowest point.
+class CutterProfile {
+private:
+    std::vector<ProfileSegment> segments;
+    float length;
+    glm::vec2 lowest;
+
+    void addLine(glm::vec2 start, glm::vec2 end) {
+        float segmentLength = glm::length(end - start);
+        if (segmentLength < 1e-6f)
+            return;
+
+        this->segments.push_back({false, start, end, glm::vec2(0.f), 0.f, 0.f, 0.f, this->length, segmentLength});
+        this->length += segmentLength;
+    }
+
+    // Counter-clockwise from angleStart to angleEnd, both within [-pi, 0] (the lower half)
+    void addArc(glm::vec2 centre, float radius, float angleStart, float angleEnd) {
+        float segmentLength = radius * (angleEnd - angleStart);
+        if (segmentLength < 1e-6f)
+            return;
+
+        glm::vec2 start = centre + radius * glm::vec2(std::cos(angleStart), std::sin(angleStart));
+        glm::vec2 end = centre + radius * glm::vec2(std::cos(angleEnd), std::sin(angleEnd));
+
+        this->segments.push_back({true, start, end, centre, radius, angleStart, angleEnd, this->length, segmentLength});
+        this->length += segmentLength;
+    }
+
+    // Lowest point: a segment end, or the bottom of an arc that passes through -pi/2
+    void findLowest() {
+        if (this->segments.empty())
+            return;
+
+        this->lowest = this->segments.front().start;
+
+        for (auto &segment : this->segments) {
+            if (segment.start.y < this->lowest.y)
+                this->lowest = segment.start;
+            if (segment.end.y < this->lowest.y)
+                this->lowest = segment.end;
+            if (segment.arc && segment.angleStart <= float(-M_PI / 2) && segment.angleEnd >= float(-M_PI / 2) &&
+                segment.centre.y - segment.radius < this->lowest.y)
+                this->lowest = segment.centre - glm::vec2(0.f, segment.radius);
+        }
+    }
+
+public:
+    explicit CutterProfile(const Cutter &cutter) : length(0.f), lowest(0.f) {
+        if (cutter.type == CUTTER_TORUS) {
+            this->addArc(glm::vec2(cutter.e, cutter.f), cutter.r, float(-M_PI), 0.f);
+            this->findLowest();
+            return;
+        }
+
+        float alpha = glm::radians(cutter.alpha);
+        float beta = glm::radians(cutter.beta);
+        glm::vec2 centre(cutter.e, cutter.f);
+
+        //Tangent points of the corner arc with the bottom line and the side line
+        glm::vec2 bottom = centre + cutter.r * glm::vec2(std::sin(alpha), -std::cos(alpha));
+        glm::vec2 side = centre + cutter.r * glm::vec2(std::cos(beta), -std::sin(beta));
+
+        glm::vec2 tip(0.f, bottom.y - bottom.x * std::tan(alpha));
+        glm::vec2 top = side + glm::vec2(std::sin(beta), std::cos(beta)) * ((cutter.h - side.y) / std::cos(beta));
+
+        this->addLine(tip, bottom);
+        this->addArc(centre, cutter.r, alpha - float(M_PI / 2), -beta);
+        if (cutter.h > side.y)
+            this->addLine(side, top);
+
+        this->findLowest();
+    }
+
+    //Accessors
+    float getLength() const {
+        return this->length;
+    }
+
+    float getInnerRadius() const {
+        return this->segments.empty() ? 0.f : this->segments.front().start.x;
+    }
+
+    // Radius of the outline seen along the axis
+    float getSilhouetteRadius() const {
+        return this->segments.empty() ? 0.f : this->segments.back().end.x;
+    }
+
+    // (radius, z) of the lowest point of the profile
+    glm::vec2 getLowestPoint() const {
+        return this->lowest;
+    }
+
+    // Arc lengths where segments meet, so tessellation can keep the corners sharp
+    std::vector<float> getBreakpoints() const {
+        std::vector<float> breakpoints;
+        for (auto &segment : this->segments)
+            breakpoints.push_back(segment.arcStart);
+        breakpoints.push_back(this->length);
+        return breakpoints;
+    }
+
+    //Functions
+    glm::vec2 point(float s) const {
+        for (auto &segment : this->segments) {
+            if (s > segment.arcStart + segment.length && &segment != &this->segments.back())
+                continue;
+
+            float t = std::clamp((s - segment.arcStart) / segment.length, 0.f, 1.f);
+
+            if (!segment.arc)
+                return segment.start + t * (segment.end - segment.start);
+
+            float angle = segment.angleStart + t * (segment.angleEnd - segment.angleStart);
+            return segment.centre + segment.radius * glm::vec2(std::cos(angle), std::sin(angle));
+        }
+
+        return glm::vec2(0.f);
+    }
+
+    // First (lowest) arc length whose radius reaches rho, or the last one that does not exceed it
+    float arcAtRadius(float rho, bool last) const {
+        float lo = 0.f, hi = this->length;
+
+        for (int i = 0; i < 48; i++) {
+            float mid = 0.5f * (lo + hi);
+            bool below = last ? this->point(mid).x <= rho : this->point(mid).x < rho;
+
+            if (below)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        return last ? lo : hi;
+    }
+
+    // Height of the lowest surface point at radius rho; false outside the footprint
+    bool heightAt(float rho, float &z) const {
+        for (auto &segment : this->segments) {
+            float rhoMin = std::min(segment.start.x, segment.end.x);
+            float rhoMax = std::max(segment.start.x, segment.end.x);
+
+            if (rho < rhoMin || rho > rhoMax)
+                continue;
+
+            if (segment.arc) {
+                float dx = rho - segment.centre.x;
+                z = segment.centre.y - std::sqrt(std::max(segment.radius * segment.radius - dx * dx, 0.f));
+            } else if (rhoMax - rhoMin < 1e-6f) {
+                z = std::min(segment.start.y, segment.end.y);
+            } else {
+                z = segment.start.y + (rho - segment.start.x) / (segment.end.x - segment.start.x) *
+                                      (segment.end.y - segment.start.y);
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // Lowest surface height over the radii [rhoMin, rhoMax]; false if the range misses the footprint.
+    // The lower profile of every supported cutter falls to its lowest point and rises after it, so
+    // the minimum is there or at one end of the range.
+    bool lowestHeightBetween(float rhoMin, float rhoMax, float &z) const {
+        rhoMin = std::max(rhoMin, this->getInnerRadius());
+        rhoMax = std::min(rhoMax, this->getSilhouetteRadius());
+
+        if (rhoMin > rhoMax)
+            return false;
+
+        if (rhoMin <= this->lowest.x && this->lowest.x <= rhoMax) {
+            z = this->lowest.y;
+            return true;
+        }
+
+        float zMin = this->lowest.y, zMax = this->lowest.y;
+        this->heightAt(rhoMin, zMin);
+        this->heightAt(rhoMax, zMax);
+        z = std::min(zMin, zMax);
+        return true;
+    }
+};
+
+// Tool map for a cutter whose axis is the view axis, evaluated from its profile at every pixel
+// centre instead of rendering and reading back the mesh. centre is the tool origin in view-space
+// xy and toolDistance its view distance; rows are bottom first, like glReadPixels. Covered pixels
+// get mask id. Only pixels inside the silhouette disc are evaluated; their spans go to spans if given.
+// maxThreads caps the threads used, as for forEachSpanChunk.
+static void evaluateCutterFootprint(const CutterProfile &profile, glm::vec2 centre, float toolDistance,
+                                    float left, float right, float bottom, float top, int width, int height,
+                                    GLfloat *distance, GLubyte *mask, GLubyte id = BODY_CUTTER,
+                                    PixelSpans *spans = nullptr, size_t maxThreads = 0) {
+    float pixelWidth = (right - left) / float(width);
+    float pixelHeight = (top - bottom) / float(height);
+
+    PixelSpans disc = discSpans(centre, profile.getSilhouetteRadius(), left, right, bottom, top, width, height);
+
+    std::fill(distance, distance + size_t(width) * height, DEPTH_BACKGROUND);
+    std::fill(mask, mask + size_t(width) * height, GLubyte(0));
+
+    forEachSpanChunk(disc, [&](size_t, int rowFirst, int rowLast) {
+        for (int row = rowFirst; row < rowLast; row++) {
+            float y = bottom + (float(row) + 0.5f) * pixelHeight - centre.y;
+
+            for (int column = disc.first[row]; column < disc.last[row]; column++) {
+                float x = left + (float(column) + 0.5f) * pixelWidth - centre.x;
+                float z;
+
+                if (profile.heightAt(std::sqrt(x * x + y * y), z)) {
+                    size_t i = size_t(row) * width + column;
+                    distance[i] = toolDistance - z;
+                    mask[i] = id;
+                }
+            }
+        }
+    }, maxThreads);
+
+    if (spans)
+        *spans = std::move(disc);
+}
+
+// Tool map of the volume swept by a cutter moving linearly from one pose to another, axis along the
+// view axis; arguments as for evaluateCutterFootprint. Over a move at constant view distance a pixel
+// sees the tool at every radius between its distance to the path and its distance to the farther
+// end, so the envelope is exact at pixel centres whatever the move length. Moves that change view
+// distance are split into pieces of at most one pixel of depth, each taken at its deeper end, so
+// the map is conservative by less than one pixel size. Only the bounding rectangle of the swept
+// silhouette is evaluated; its spans go to spans if given.
+static void evaluateSweptFootprint(const CutterProfile &profile, glm::vec2 centreFrom, glm::vec2 centreTo,
+                                   float distanceFrom, float distanceTo,
+                                   float left, float right, float bottom, float top, int width, int height,
+                                   GLfloat *distance, GLubyte *mask, GLubyte id = BODY_CUTTER,
+                                   PixelSpans *spans = nullptr, size_t maxThreads = 0) {
+    float pixelWidth = (right - left) / float(width);
+    float pixelHeight = (top - bottom) / float(height);
+
+    int pieces = std::max(1, int(std::ceil(std::abs(distanceTo - distanceFrom) / std::min(pixelWidth, pixelHeight))));
+
+    float radius = profile.getSilhouetteRadius();
+    PixelSpans swept = rectangleSpans(glm::min(centreFrom, centreTo) - glm::vec2(radius),
+                                      glm::max(centreFrom, centreTo) + glm::vec2(radius),
+                                      left, right, bottom, top, width, height);
+
+    std::fill(distance, distance + size_t(width) * height, DEPTH_BACKGROUND);
+    std::fill(mask, mask + size_t(width) * height, GLubyte(0));
+
+    forEachSpanChunk(swept, [&](size_t, int rowFirst, int rowLast) {
+        for (int row = rowFirst; row < rowLast; row++) {
+            for (int column = swept.first[row]; column < swept.last[row]; column++) {
+                glm::vec2 q(left + (float(column) + 0.5f) * pixelWidth,
+                            bottom + (float(row) + 0.5f) * pixelHeight);
+
+                bool covered = false;
+                float deepest = 0.f;
+
+                for (int k = 0; k < pieces; k++) {
+                    float t0 = float(k) / float(pieces), t1 = float(k + 1) / float(pieces);
+                    glm::vec2 a = glm::mix(centreFrom, centreTo, t0);
+                    glm::vec2 b = glm::mix(centreFrom, centreTo, t1);
+                    float pieceDistance = std::max(glm::mix(distanceFrom, distanceTo, t0),
+                                                   glm::mix(distanceFrom, distanceTo, t1));
+
+                    glm::vec2 ab = b - a;
+                    float lengthSquared = glm::dot(ab, ab);
+                    float t = lengthSquared > 0.f ? std::clamp(glm::dot(q - a, ab) / lengthSquared, 0.f, 1.f) : 0.f;
+
+                    float rhoMin = glm::length(q - (a + t * ab));
+                    float rhoMax = std::max(glm::length(q - a), glm::length(q - b));
+                    float z;
+
+                    if (profile.lowestHeightBetween(rhoMin, rhoMax, z) && (!covered || pieceDistance - z > deepest)) {
+                        deepest = pieceDistance - z;
+                        covered = true;
+                    }
+                }
+
+                if (covered) {
+                    size_t i = size_t(row) * width + column;
+                    distance[i] = deepest;
+                    mask[i] = id;
+                }
+            }
+        }
+    }, maxThreads);
+
+    if (spans)
+        *spans = std::move(swept);
+}
+
+// Combines the tool map of another body into distance/mask, keeping per pixel the surface farther
+// from the camera (the one that meets the workpiece first) and its body ID
+static void mergeDeepestSurface(GLfloat *distance, GLubyte *mask, const GLfloat *bodyDistance, const GLubyte *bodyMask,
+                                size_t nrOfPixels) {
+    forEachPixelChunk(nrOfPixels, [&](size_t, size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            if (bodyMask[i] && (!mask[i] || bodyDistance[i] > distance[i])) {
+                distance[i] = bodyDistance[i];
+                mask[i] = bodyMask[i];
+            }
+        }
+    });
+}
+
+// mergeDeepestSurface over the body's spans only; spans grows to cover them
+static void mergeDeepestSurface(GLfloat *distance, GLubyte *mask, PixelSpans &spans,
+                                const GLfloat *bodyDistance, const GLubyte *bodyMask, const PixelSpans &bodySpans,
+                                size_t maxThreads = 0) {
+    forEachSpanChunk(bodySpans, [&](size_t, int rowFirst, int rowLast) {
+        for (int row = rowFirst; row < rowLast; row++) {
+            size_t rowStart = size_t(row) * bodySpans.width;
+
+            for (size_t i = rowStart + bodySpans.first[row]; i < rowStart + bodySpans.last[row]; i++) {
+                if (bodyMask[i] && (!mask[i] || bodyDistance[i] > distance[i])) {
+                    distance[i] = bodyDistance[i];
+                    mask[i] = bodyMask[i];
+                }
+            }
+        }
+    }, maxThreads);
+
+    uniteSpans(spans, bodySpans);
+}
+
+#endif //OPENGL_5_AXIS_CUTTER_H
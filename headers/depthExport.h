@@ -0,0 +1,118 @@
+#ifndef OPENGL_5_AXIS_DEPTHEXPORT_H
+#define OPENGL_5_AXIS_DEPTHEXPORT_H
+
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+enum export_format {
+    EXPORT_NONE = 0,
+    EXPORT_PFM,
+    EXPORT_NPY
+};
+
+// Rows per write when a map has to be computed or reordered on the way out
+const int EXPORT_CHUNK_ROWS = 64;
+
+static const char *exportExtension(export_format format) {
+    return format == EXPORT_NPY ? ".npy" : ".pfm";
+}
+
+// PFM stores rows bottom to top, the same order glReadPixels returns them in.
+// NPY rows are written top to bottom so the array reads like the image on screen.
+static void writeFloatMapHeader(std::ofstream &out, export_format format, int width, int height) {
+    bool littleEndian = std::endian::native == std::endian::little;
+
+    if (format == EXPORT_PFM) {
+        out << "Pf\n" << width << " " << height << "\n" << (littleEndian ? "-1.0" : "1.0") << "\n";
+        return;
+    }
+
+    std::string header = "{'descr': '";
+    header += littleEndian ? "<f4" : ">f4";
+    header += "', 'fortran_order': False, 'shape': (" + std::to_string(height) + ", " + std::to_string(width) + "), }";
+
+    //Magic, version, header length, then the dict padded with spaces to a 64 byte boundary ending in \n
+    size_t preamble = 6 + 2 + 2;
+    header.append(63 - (preamble + header.size()) % 64, ' ');
+    header += '\n';
+
+    auto headerLength = (unsigned short) header.size();
+    unsigned char lengthBytes[2] = {(unsigned char) (headerLength & 0xff), (unsigned char) (headerLength >> 8)};
+
+    out.write("\x93NUMPY\x01\x00", 8);
+    out.write((const char *) lengthBytes, 2);
+    out.write(header.data(), (std::streamsize) header.size());
+}
+
+static bool openFloatMap(std::ofstream &out, const std::string &filename, export_format format, int width, int height) {
+    out.open(filename, std::ios::binary);
+
+    if (!out.is_open()) {
+        std::cout << "ERROR::DEPTHEXPORT::COULD_NOT_OPEN_FILE: " << filename << "\n";
+        return false;
+    }
+
+    writeFloatMapHeader(out, format, width, height);
+    return true;
+}
+
+// Streams a bottom-up float buffer (as read back from GL) straight to disk
+static bool exportFloatMap(const std::string &filename, export_format format,
+                           const GLfloat *data, int width, int height) {
+    std::ofstream out;
+    if (!openFloatMap(out, filename, format, width, height))
+        return false;
+
+    if (format == EXPORT_PFM) {
+        for (int row = 0; row < height; row += EXPORT_CHUNK_ROWS) {
+            int rows = std::min(EXPORT_CHUNK_ROWS, height - row);
+            out.write((const char *) (data + (size_t) row * width), (std::streamsize) sizeof(GLfloat) * rows * width);
+        }
+    } else {
+        for (int row = height - 1; row >= 0; row--)
+            out.write((const char *) (data + (size_t) row * width), (std::streamsize) sizeof(GLfloat) * width);
+    }
+
+    return out.good();
+}
+
+// Streams workpiece - tool, one chunk of rows at a time. Pixels the tool does not cover are NaN.
+static bool exportClearanceMap(const std::string &filename, export_format format,
+                               const GLfloat *workpiece, const GLfloat *tool, const GLubyte *toolMask,
+                               int width, int height) {
+    std::ofstream out;
+    if (!openFloatMap(out, filename, format, width, height))
+        return false;
+
+    std::vector<GLfloat> chunk((size_t) EXPORT_CHUNK_ROWS * width);
+
+    for (int written = 0; written < height; written += EXPORT_CHUNK_ROWS) {
+        int rows = std::min(EXPORT_CHUNK_ROWS, height - written);
+
+        for (int r = 0; r < rows; r++) {
+            int row = format == EXPORT_PFM ? written + r : height - 1 - (written + r);
+            const GLfloat *w = workpiece + (size_t) row * width;
+            const GLfloat *t = tool + (size_t) row * width;
+            const GLubyte *m = toolMask + (size_t) row * width;
+            GLfloat *c = chunk.data() + (size_t) r * width;
+
+            for (int i = 0; i < width; i++)
+                c[i] = m[i] ? w[i] - t[i] : std::numeric_limits<GLfloat>::quiet_NaN();
+        }
+
+        out.write((const char *) chunk.data(), (std::streamsize) sizeof(GLfloat) * rows * width);
+    }
+
+    return out.good();
+}
+
+#endif //OPENGL_5_AXIS_DEPTHEXPORT_H
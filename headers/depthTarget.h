@@ -0,0 +1,234 @@
+#ifndef OPENGL_5_AXIS_DEPTHTARGET_H
+#define OPENGL_5_AXIS_DEPTHTARGET_H
+
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+
+#include "contact.h"
+
+// IEEE 754 binary16 to float
+static float halfToFloat(GLushort half) {
+    uint32_t sign = uint32_t(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1fu;
+    uint32_t mantissa = half & 0x3ffu;
+    uint32_t bits;
+
+    if (exponent == 0 && mantissa == 0) {
+        bits = sign;
+    } else if (exponent == 0) {
+        //Subnormal: normalise the mantissa
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400u)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Largest rounding error of a half float holding a value of magnitude up to maxValue
+static float halfFloatError(float maxValue) {
+    int exponent;
+    std::frexp(maxValue, &exponent);
+    return std::ldexp(1.f, exponent - 12);
+}
+
+// Offscreen render target with a 32-bit float depth buffer. Contact passes render here instead
+// of into the default framebuffer, whose depth is usually 24-bit fixed point. Besides the colour
+// shown in the window, the core shader writes view distance (R32F, attachment 1) and the ID of the
+// body drawn (R8UI, attachment 2), so readback needs no decoding and background is explicit.
+class DepthTarget {
+private:
+    GLuint fbo;
+    GLuint colorBuffer;
+    GLuint distanceBuffer;
+    GLuint coverageBuffer;
+    GLuint depthBuffer;
+
+    GLsizei width;
+    GLsizei height;
+
+    std::vector<GLushort> halfPixels;
+
+    // glReadPixels writes the rectangle straight into its place in a full-size map
+    void packInto(const PixelRect &rect) const {
+        glPixelStorei(GL_PACK_ROW_LENGTH, this->width);
+        glPixelStorei(GL_PACK_SKIP_PIXELS, rect.x);
+        glPixelStorei(GL_PACK_SKIP_ROWS, rect.y);
+    }
+
+    static void resetPack() {
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+    }
+
+public:
+    DepthTarget(GLsizei width, GLsizei height) : width(width), height(height) {
+        glGenFramebuffers(1, &this->fbo);
+        glGenRenderbuffers(1, &this->colorBuffer);
+        glGenRenderbuffers(1, &this->distanceBuffer);
+        glGenRenderbuffers(1, &this->coverageBuffer);
+        glGenRenderbuffers(1, &this->depthBuffer);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->distanceBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_R32F, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->coverageBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_R8UI, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_RENDERBUFFER, this->distanceBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_RENDERBUFFER, this->coverageBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+
+        const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(3, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEPTHTARGET::FRAMEBUFFER_INCOMPLETE"
+                      << "\n";
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~DepthTarget() {
+        glDeleteFramebuffers(1, &this->fbo);
+        glDeleteRenderbuffers(1, &this->colorBuffer);
+        glDeleteRenderbuffers(1, &this->distanceBuffer);
+        glDeleteRenderbuffers(1, &this->coverageBuffer);
+        glDeleteRenderbuffers(1, &this->depthBuffer);
+    }
+
+    DepthTarget(const DepthTarget &) = delete;
+
+    DepthTarget &operator=(const DepthTarget &) = delete;
+
+    //Accessors
+    GLsizei getWidth() const {
+        return this->width;
+    }
+
+    GLsizei getHeight() const {
+        return this->height;
+    }
+
+    PixelRect getRect() const {
+        return PixelRect{0, 0, this->width, this->height};
+    }
+
+    //Functions
+    void bind() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+        glViewport(0, 0, this->width, this->height);
+    }
+
+    // glClear would write the float clear colour into the integer coverage buffer, so each
+    // attachment is cleared separately; distance starts at background, depth at the far plane (0
+    // with reversed-Z) unless a pass keeps the farthest surface
+    void clear(float background, GLfloat depth = 0.f) const {
+        const GLfloat black[] = {0.f, 0.f, 0.f, 1.f};
+        const GLfloat distance[] = {background, 0.f, 0.f, 0.f};
+        const GLuint uncovered[] = {0, 0, 0, 0};
+
+        glClearBufferfv(GL_COLOR, 0, black);
+        glClearBufferfv(GL_COLOR, 1, distance);
+        glClearBufferuiv(GL_COLOR, 2, uncovered);
+        glClearBufferfv(GL_DEPTH, 0, &depth);
+    }
+
+    // View distance per pixel, bottom row first
+    void readDistance(GLfloat *pixels) {
+        this->readDistance(pixels, this->getRect());
+    }
+
+    // View distance of the pixels in rect only, written at their place in the full-size map; the rest
+    // of pixels is left as it was. With halfFloat the transfer is half the size, at the precision
+    // given by halfFloatError.
+    void readDistance(GLfloat *pixels, const PixelRect &rect, bool halfFloat = false) {
+        if (rect.empty())
+            return;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+
+        if (!halfFloat) {
+            this->packInto(rect);
+            glReadPixels(rect.x, rect.y, rect.width, rect.height, GL_RED, GL_FLOAT, pixels);
+            DepthTarget::resetPack();
+            return;
+        }
+
+        this->halfPixels.resize(size_t(rect.width) * rect.height);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(rect.x, rect.y, rect.width, rect.height, GL_RED, GL_HALF_FLOAT, this->halfPixels.data());
+
+        for (int row = 0; row < rect.height; row++) {
+            const GLushort *source = this->halfPixels.data() + size_t(row) * rect.width;
+            GLfloat *target = pixels + size_t(rect.y + row) * this->width + rect.x;
+
+            for (int column = 0; column < rect.width; column++)
+                target[column] = halfToFloat(source[column]);
+        }
+    }
+
+    // Body ID where a surface was drawn, 0 for background
+    void readCoverage(GLubyte *mask) const {
+        this->readCoverage(mask, this->getRect());
+    }
+
+    // Body IDs of the pixels in rect only, like readDistance
+    void readCoverage(GLubyte *mask, const PixelRect &rect) const {
+        if (rect.empty())
+            return;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT2);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        this->packInto(rect);
+        glReadPixels(rect.x, rect.y, rect.width, rect.height, GL_RED_INTEGER, GL_UNSIGNED_BYTE, mask);
+        DepthTarget::resetPack();
+    }
+
+    // Copies the colour attachment to the window, scaled to its framebuffer size
+    void blitToScreen(int framebufferWidth, int framebufferHeight) const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, framebufferWidth, framebufferHeight,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    }
+};
+
+// Switches depth to the [0, 1] clip range when the driver allows it, so the reversed-Z mapping
+// keeps full float precision instead of going through the [-1, 1] -> [0, 1] remap. Returns
+// whether it was enabled.
+static bool enableZeroToOneDepth() {
+    if (!GLEW_VERSION_4_5 && !GLEW_ARB_clip_control)
+        return false;
+
+    glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+    return true;
+}
+
+#endif //OPENGL_5_AXIS_DEPTHTARGET_H
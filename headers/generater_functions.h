@@ -2,10 +2,45 @@
 #define OPENGL_GENERATER_FUNCTIONS_H
 
 #include <vector>
+#include <tuple>
 #include "vertex.h"
+#include "meshlet.h"
+#include "cutter.h"
+#include "zmap.h"
+#include "nurbs.h"
 
-std::vector<Vertex> generateTriangles();
+// Level of detail for a cutter mesh. The profile is sampled by arc length on a fixed grid of
+// step CUTTER_LOD_EDGE_PIXELS * 2^level (in world units along the surface), and the revolution
+// angle so that the silhouette gets the same spacing; two windows that snap to the same sample
+// indices share one cached mesh.
+struct CutterLod {
+    int level;
+    long profile_first;
+    long profile_last;
+    long phi_first;
+    long phi_last;
+
+    bool operator<(const CutterLod &other) const {
+        return std::tie(level, profile_first, profile_last, phi_first, phi_last) <
+               std::tie(other.level, other.profile_first, other.profile_last, other.phi_first, other.phi_last);
+    }
+};
+
+std::vector<Vertex> generateTriangles(std::vector<Meshlet> *meshlets = nullptr);
 std::vector<Vertex> generateTorus();
+std::vector<Vertex> generateCutter(const CutterProfile &profile, const CutterLod &lod);
+
+// Level of detail for the pixel size of the window. With crop the mesh only covers the part of the
+// cutter inside the window around cutterCenter (view space), which is only valid while the cutter
+// axis is the view axis at unit scale; otherwise the whole cutter is kept.
+CutterLod selectCutterLod(const CutterProfile &profile, float left, float right, float bottom, float top,
+                          int width, int height, glm::vec2 cutterCenter, bool crop = true);
+
+void generateZMapMesh(const ZMap &zmap, std::vector<Vertex> &vertices, std::vector<GLuint> &indices,
+                      std::vector<Meshlet> *meshlets = nullptr);
+
+void generateNurbsMesh(const std::vector<NurbsPatch> &patches, std::vector<Vertex> &vertices,
+                       std::vector<GLuint> &indices, std::vector<Meshlet> *meshlets = nullptr);
 
 
 
@@ -20,6 +20,8 @@
 #include "vertex.h"
 #include "shader.h"
 #include "primitives.h"
+#include "meshlet.h"
+#include "transform.h"
 
 
 class Mesh {
@@ -33,30 +35,44 @@ private:
     GLuint VBO{};
     GLuint EBO{};
 
-    glm::vec3 position{};
-    glm::vec3 origin{};
-    glm::vec3 rotation{};
-    glm::vec3 scale{};
+    //Handle into transformStore()
+    unsigned transform;
 
-    glm::mat4 ModelMatrix{};
+    glm::vec3 aabbMin{};
+    glm::vec3 aabbMax{};
+    std::vector<Meshlet> meshlets;
 
     void initVAO() {
-        //Create VAO
-        glCreateVertexArrays(1, &this->VAO);
-        glBindVertexArray(this->VAO);
+        //GEN VBO AND SEND DATA
+        glCreateBuffers(1, &this->VBO);
+        glNamedBufferData(this->VBO, this->nrOfVertices * sizeof(Vertex), this->vertexArray, GL_STATIC_DRAW);
 
-        //GEN VBO AND BIND AND SEND DATA
-        glGenBuffers(1, &this->VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferData(GL_ARRAY_BUFFER, this->nrOfVertices * sizeof(Vertex), this->vertexArray, GL_STATIC_DRAW);
-
-        //GEN EBO AND BIND AND SEND DATA
+        //GEN EBO AND SEND DATA
         if (this->nrOfIndices > 0) {
-            glGenBuffers(1, &this->EBO);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->nrOfIndices * sizeof(GLuint), this->indexArray, GL_STATIC_DRAW);
+            glCreateBuffers(1, &this->EBO);
+            glNamedBufferData(this->EBO, this->nrOfIndices * sizeof(GLuint), this->indexArray, GL_STATIC_DRAW);
         }
 
+        this->VAO = this->createVertexArray();
+    }
+
+    void updateUniforms(Shader *shader) {
+        shader->setMat4fv(transformStore().getMatrix(this->transform), "ModelMatrix");
+    }
+
+public:
+    //A vertex array over this mesh's buffers in the current context. Buffers are shared between
+    //contexts but vertex arrays are not, so other contexts draw through one of these.
+    GLuint createVertexArray() const {
+        GLuint vertexArray;
+
+        glCreateVertexArrays(1, &vertexArray);
+        glBindVertexArray(vertexArray);
+
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        if (this->nrOfIndices > 0)
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+
         //SET VERTEXATTRIBPOINTERS AND ENABLE (INPUT ASSEMBLY)
         //Position
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid *) offsetof(Vertex, position));
@@ -73,23 +89,10 @@ private:
 
         //BIND VAO 0
         glBindVertexArray(0);
-    }
-
-    void updateUniforms(Shader *shader) {
-        shader->setMat4fv(this->ModelMatrix, "ModelMatrix");
-    }
 
-    void updateModelMatrix() {
-        this->ModelMatrix = glm::mat4(1.f);
-        this->ModelMatrix = glm::translate(this->ModelMatrix, this->origin);
-        this->ModelMatrix = glm::rotate(this->ModelMatrix, glm::radians(this->rotation.x), glm::vec3(1.f, 0.f, 0.f));
-        this->ModelMatrix = glm::rotate(this->ModelMatrix, glm::radians(this->rotation.y), glm::vec3(0.f, 1.f, 0.f));
-        this->ModelMatrix = glm::rotate(this->ModelMatrix, glm::radians(this->rotation.z), glm::vec3(0.f, 0.f, 1.f));
-        this->ModelMatrix = glm::translate(this->ModelMatrix, this->position - this->origin);
-        this->ModelMatrix = glm::scale(this->ModelMatrix, this->scale);
+        return vertexArray;
     }
 
-public:
     Mesh(
             Vertex *vertexArray,
             const unsigned &nrOfVertices,
@@ -99,10 +102,7 @@ public:
             glm::vec3 origin = glm::vec3(0.f),
             glm::vec3 rotation = glm::vec3(0.f),
             glm::vec3 scale = glm::vec3(1.f)) {
-        this->position = position;
-        this->origin = origin;
-        this->rotation = rotation;
-        this->scale = scale;
+        this->transform = transformStore().allocate(position, origin, rotation, scale);
 
         this->nrOfVertices = nrOfVertices;
         this->nrOfIndices = nrOfIndices;
@@ -117,8 +117,8 @@ public:
             this->indexArray[i] = indexArray[i];
         }
 
+        computeBounds(this->vertexArray, this->nrOfVertices, this->aabbMin, this->aabbMax);
         this->initVAO();
-        this->updateModelMatrix();
     }
 
     explicit Mesh(
@@ -127,10 +127,7 @@ public:
             glm::vec3 origin = glm::vec3(0.f),
             glm::vec3 rotation = glm::vec3(0.f),
             glm::vec3 scale = glm::vec3(1.f)) {
-        this->position = position;
-        this->origin = origin;
-        this->rotation = rotation;
-        this->scale = scale;
+        this->transform = transformStore().allocate(position, origin, rotation, scale);
 
         this->nrOfVertices = primitive->getNrOfVertices();
         this->nrOfIndices = primitive->getNrOfIndices();
@@ -145,15 +142,14 @@ public:
             this->indexArray[i] = primitive->getIndices()[i];
         }
 
+        computeBounds(this->vertexArray, this->nrOfVertices, this->aabbMin, this->aabbMax);
         this->initVAO();
-        this->updateModelMatrix();
     }
 
     Mesh(const Mesh &obj) {
-        this->position = obj.position;
-        this->origin = obj.origin;
-        this->rotation = obj.rotation;
-        this->scale = obj.scale;
+        TransformStore &store = transformStore();
+        this->transform = store.allocate(store.getPosition(obj.transform), store.getOrigin(obj.transform),
+                                         store.getRotation(obj.transform), store.getScale(obj.transform));
 
         this->nrOfVertices = obj.nrOfVertices;
         this->nrOfIndices = obj.nrOfIndices;
@@ -168,8 +164,11 @@ public:
             this->indexArray[i] = obj.indexArray[i];
         }
 
+        this->aabbMin = obj.aabbMin;
+        this->aabbMax = obj.aabbMax;
+        this->meshlets = obj.meshlets;
+
         this->initVAO();
-        this->updateModelMatrix();
     }
 
     ~Mesh() {
@@ -182,40 +181,87 @@ public:
 
         delete[] this->vertexArray;
         delete[] this->indexArray;
+
+        transformStore().release(this->transform);
     }
 
     //Accessors
+    glm::mat4 getModelMatrix() const {
+        return transformStore().getMatrix(this->transform);
+    }
+
+    glm::vec3 getRotation() const {
+        return transformStore().getRotation(this->transform);
+    }
+
+    glm::vec3 getScale() const {
+        return transformStore().getScale(this->transform);
+    }
+
+    glm::vec3 getAabbMin() const {
+        return this->aabbMin;
+    }
+
+    glm::vec3 getAabbMax() const {
+        return this->aabbMax;
+    }
+
+    //CPU copy of the uploaded data, e.g. for export
+    const Vertex *getVertices() const {
+        return this->vertexArray;
+    }
+
+    unsigned getNrOfVertices() const {
+        return this->nrOfVertices;
+    }
+
+    const GLuint *getIndices() const {
+        return this->indexArray;
+    }
+
+    unsigned getNrOfIndices() const {
+        return this->nrOfIndices;
+    }
 
     //Modifiers
+    void setMeshlets(const std::vector<Meshlet> &tiles) {
+        this->meshlets = tiles;
+    }
+
     void setPosition(const glm::vec3 pos) {
-        this->position = pos;
+        transformStore().setPosition(this->transform, pos);
     }
 
     void setOrigin(const glm::vec3 orig) {
-        this->origin = orig;
+        transformStore().setOrigin(this->transform, orig);
     }
 
     void setRotation(const glm::vec3 rot) {
-        this->rotation = rot;
+        transformStore().setRotation(this->transform, rot);
     }
 
     void setScale(const glm::vec3 setScale) {
-        this->scale = setScale;
+        transformStore().setScale(this->transform, setScale);
     }
 
     //Functions
 
     void move(const glm::vec3 pos) {
-        this->position += pos;
-        this->setOrigin(this->position);
+        TransformStore &store = transformStore();
+        glm::vec3 position = store.getPosition(this->transform) + pos;
+
+        store.setPosition(this->transform, position);
+        store.setOrigin(this->transform, position);
     }
 
     void rotate(const glm::vec3 rot) {
-        this->rotation += rot;
+        TransformStore &store = transformStore();
+        store.setRotation(this->transform, store.getRotation(this->transform) + rot);
     }
 
     void scaleUp(const glm::vec3 scal) {
-        this->scale += scal;
+        TransformStore &store = transformStore();
+        store.setScale(this->transform, store.getScale(this->transform) + scal);
     }
 
     void update() {
@@ -223,14 +269,17 @@ public:
     }
 
     void render(Shader *shader) {
+        this->render(shader, this->VAO);
+    }
+
+    void render(Shader *shader, GLuint vertexArray) {
         //Update uniforms
-        this->updateModelMatrix();
         this->updateUniforms(shader);
 
         shader->use();
 
         //Bind VAO
-        glBindVertexArray(this->VAO);
+        glBindVertexArray(vertexArray);
 
         //RENDER
         if (this->nrOfIndices == 0)
@@ -244,6 +293,64 @@ public:
         glActiveTexture(0);
         glBindTexture(GL_TEXTURE_2D, 0);
     }
+
+    //Draws only the meshlets whose bounding boxes intersect the given View-Projection frustum
+    void render(Shader *shader, const glm::mat4 &ViewProjectionMatrix) {
+        this->render(shader, ViewProjectionMatrix, this->VAO);
+    }
+
+    void render(Shader *shader, const glm::mat4 &ViewProjectionMatrix, GLuint vertexArray) {
+        //Scratch lists for the draw ranges that survive culling; per thread, since pose workers
+        //draw the same meshes at the same time
+        static thread_local std::vector<GLint> visibleFirsts;
+        static thread_local std::vector<GLsizei> visibleCounts;
+        static thread_local std::vector<const void *> visibleOffsets;
+
+        glm::mat4 MVP = ViewProjectionMatrix * transformStore().getMatrix(this->transform);
+
+        if (isOutsideFrustum(this->aabbMin, this->aabbMax, MVP))
+            return;
+
+        if (this->meshlets.empty()) {
+            this->render(shader, vertexArray);
+            return;
+        }
+
+        visibleFirsts.clear();
+        visibleCounts.clear();
+        visibleOffsets.clear();
+
+        for (auto &meshlet : this->meshlets) {
+            if (isOutsideFrustum(meshlet.aabbMin, meshlet.aabbMax, MVP))
+                continue;
+
+            visibleFirsts.push_back(meshlet.first);
+            visibleCounts.push_back(meshlet.count);
+            visibleOffsets.push_back((const void *) (meshlet.first * sizeof(GLuint)));
+        }
+
+        if (visibleCounts.empty())
+            return;
+
+        this->updateUniforms(shader);
+
+        shader->use();
+
+        glBindVertexArray(vertexArray);
+
+        if (this->nrOfIndices == 0)
+            glMultiDrawArrays(GL_TRIANGLES, visibleFirsts.data(), visibleCounts.data(),
+                              (GLsizei) visibleCounts.size());
+        else
+            glMultiDrawElements(GL_TRIANGLES, visibleCounts.data(), GL_UNSIGNED_INT,
+                                visibleOffsets.data(), (GLsizei) visibleCounts.size());
+
+        //Cleanup
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glActiveTexture(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
 };
 
 #endif //OPENGL_5_AXIS_MESH_H
@@ -0,0 +1,272 @@
+#ifndef OPENGL_5_AXIS_MESHOPTIMIZER_H
+#define OPENGL_5_AXIS_MESHOPTIMIZER_H
+
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+#include "vertex.h"
+
+// Post-transform vertex cache size assumed when ordering triangles; close to the FIFO size of
+// current GPUs, and a smaller guess than the real cache costs little
+const int MESH_CACHE_SIZE = 16;
+
+// Bit pattern of a whole Vertex, so only vertices identical in every attribute are welded
+struct VertexKey {
+    uint32_t bits[sizeof(Vertex) / sizeof(uint32_t)];
+
+    explicit VertexKey(const Vertex &vertex) : bits{} {
+        std::memcpy(this->bits, &vertex, sizeof(Vertex));
+    }
+
+    bool operator==(const VertexKey &other) const {
+        return std::memcmp(this->bits, other.bits, sizeof(this->bits)) == 0;
+    }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey &key) const {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t word : key.bits) {
+            hash ^= word;
+            hash *= 1099511628211ull;
+        }
+        return size_t(hash ^ (hash >> 32));
+    }
+};
+
+// Indexed mesh from a triangle soup (three corners per triangle, as loadObjFile returns them);
+// vertices are numbered in the order they first appear
+static void weldVertices(const std::vector<Vertex> &corners, std::vector<Vertex> &vertices,
+                         std::vector<GLuint> &indices) {
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> seen;
+    seen.reserve(corners.size());
+
+    vertices.clear();
+    indices.resize(corners.size());
+
+    for (size_t c = 0; c < corners.size(); c++) {
+        auto inserted = seen.emplace(VertexKey(corners[c]), GLuint(vertices.size()));
+        if (inserted.second)
+            vertices.push_back(corners[c]);
+        indices[c] = inserted.first->second;
+    }
+}
+
+// Reorders triangles for the post-transform vertex cache with Tipsify (Sander, Nehab and Barczak,
+// "Fast triangle reordering for vertex locality and reduced overdraw", 2007): triangles are fanned
+// around one vertex at a time, moving next to the candidate that will still be in the cache. Where
+// no candidate is left the walk restarts cold; those positions are written to clusterStarts, since
+// triangles can be moved there without losing cache hits.
+static void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount,
+                                std::vector<size_t> *clusterStarts = nullptr) {
+    const size_t triangleCount = indices.size() / 3;
+
+    //Triangles around every vertex, as offsets into one array
+    std::vector<GLuint> liveTriangles(vertexCount, 0);
+    for (size_t c = 0; c < triangleCount * 3; c++)
+        liveTriangles[indices[c]]++;
+
+    std::vector<size_t> adjacencyFirst(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyFirst[v + 1] = adjacencyFirst[v] + liveTriangles[v];
+
+    std::vector<GLuint> adjacency(adjacencyFirst[vertexCount]);
+    std::vector<size_t> adjacencyNext(adjacencyFirst.begin(), adjacencyFirst.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[adjacencyNext[indices[t * 3 + k]]++] = GLuint(t);
+
+    std::vector<int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<GLuint> deadEnds;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> ordered;
+    ordered.reserve(triangleCount * 3);
+
+    int time = MESH_CACHE_SIZE + 1;
+    size_t cursor = 0;
+    long fanning = vertexCount > 0 ? 0 : -1;
+
+    if (clusterStarts)
+        clusterStarts->assign(1, 0);
+
+    while (fanning >= 0) {
+        candidates.clear();
+
+        for (size_t a = adjacencyFirst[fanning]; a < adjacencyFirst[fanning + 1]; a++) {
+            GLuint t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (int k = 0; k < 3; k++) {
+                GLuint v = indices[t * 3 + k];
+                ordered.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+
+                if (time - cacheTime[v] > MESH_CACHE_SIZE)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        //Next fan: the candidate with live triangles that stays in the cache longest
+        long next = -1;
+        int best = -1;
+        for (GLuint v : candidates) {
+            if (liveTriangles[v] == 0)
+                continue;
+
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * int(liveTriangles[v]) <= MESH_CACHE_SIZE)
+                priority = time - cacheTime[v];
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+
+        if (next < 0) {
+            //Dead end: a recently used vertex if one still has triangles, else the next in index order
+            while (!deadEnds.empty() && next < 0) {
+                GLuint v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0)
+                    next = v;
+            }
+
+            while (next < 0 && cursor < vertexCount) {
+                if (liveTriangles[cursor] > 0)
+                    next = long(cursor);
+                cursor++;
+            }
+
+            if (clusterStarts && next >= 0 && ordered.size() / 3 > clusterStarts->back())
+                clusterStarts->push_back(ordered.size() / 3);
+        }
+
+        fanning = next;
+    }
+
+    indices.swap(ordered);
+}
+
+// Reorders the clusters found by optimizeVertexCache so that triangles likely to occlude others
+// are drawn first, which lets early depth testing reject more fragments whatever the view
+// direction: clusters far out from the mesh centre along their own normal go first (Sander et al.)
+static void optimizeOverdraw(std::vector<GLuint> &indices, const std::vector<Vertex> &vertices,
+                             const std::vector<size_t> &clusterStarts) {
+    const size_t triangleCount = indices.size() / 3;
+    const size_t clusterCount = clusterStarts.size();
+    if (clusterCount < 2)
+        return;
+
+    //Area-weighted centroid of the whole mesh
+    glm::vec3 meshCentroid(0.f);
+    float meshArea = 0.f;
+    std::vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.f));
+
+    for (size_t c = 0; c < clusterCount; c++) {
+        size_t last = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+        float clusterArea = 0.f;
+
+        for (size_t t = clusterStarts[c]; t < last; t++) {
+            glm::vec3 a = vertices[indices[t * 3]].position;
+            glm::vec3 b = vertices[indices[t * 3 + 1]].position;
+            glm::vec3 d = vertices[indices[t * 3 + 2]].position;
+
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal);
+
+            clusterCentroid[c] += area * (a + b + d) / 3.f;
+            clusterNormal[c] += normal;
+            clusterArea += area;
+        }
+
+        meshCentroid += clusterCentroid[c];
+        meshArea += clusterArea;
+        if (clusterArea > 0.f)
+            clusterCentroid[c] /= clusterArea;
+    }
+
+    if (meshArea > 0.f)
+        meshCentroid /= meshArea;
+
+    std::vector<float> occlusion(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        float length = glm::length(clusterNormal[c]);
+        occlusion[c] = length > 0.f ? glm::dot(clusterCentroid[c] - meshCentroid, clusterNormal[c] / length) : 0.f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return occlusion[a] > occlusion[b]; });
+
+    std::vector<GLuint> sorted;
+    sorted.reserve(indices.size());
+    for (size_t c : order) {
+        size_t last = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+        sorted.insert(sorted.end(), indices.begin() + long(clusterStarts[c] * 3), indices.begin() + long(last * 3));
+    }
+
+    indices.swap(sorted);
+}
+
+// Renumbers vertices in the order the index buffer first uses them, so vertex fetches walk the
+// buffer forwards; unreferenced vertices are dropped
+static void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<GLuint> &indices) {
+    const GLuint unused = GLuint(-1);
+    std::vector<GLuint> remap(vertices.size(), unused);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (auto &index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = GLuint(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(reordered);
+}
+
+// The whole stage for a loaded indexed mesh: cache order, then overdraw order across the cache
+// restarts, then fetch order
+static void optimizeMesh(std::vector<Vertex> &vertices, std::vector<GLuint> &indices) {
+    std::vector<size_t> clusterStarts;
+
+    optimizeVertexCache(indices, vertices.size(), &clusterStarts);
+    optimizeOverdraw(indices, vertices, clusterStarts);
+    optimizeVertexFetch(vertices, indices);
+}
+
+// Average number of vertices transformed per triangle for a FIFO cache of the given size; 0.5 is
+// the best a regular grid allows, 3 means no reuse at all
+static float averageCacheMissRatio(const std::vector<GLuint> &indices, size_t vertexCount,
+                                   int cacheSize = MESH_CACHE_SIZE) {
+    std::vector<long> insertedAt(vertexCount, -cacheSize - 1);
+    long misses = 0;
+
+    for (GLuint index : indices) {
+        if (misses - insertedAt[index] > cacheSize) {
+            insertedAt[index] = misses;
+            misses++;
+        }
+    }
+
+    return indices.empty() ? 0.f : float(misses) / float(indices.size() / 3);
+}
+
+#endif //OPENGL_5_AXIS_MESHOPTIMIZER_H
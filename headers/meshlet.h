@@ -0,0 +1,68 @@
+#ifndef OPENGL_5_AXIS_MESHLET_H
+#define OPENGL_5_AXIS_MESHLET_H
+
+
+#include <vector>
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "vertex.h"
+
+// A spatial tile of a mesh: a contiguous range of vertices (or indices, for indexed meshes)
+// together with its model-space bounding box.
+struct Meshlet {
+    GLint first;
+    GLsizei count;
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
+};
+
+static void computeBounds(const Vertex *vertices, const unsigned nrOfVertices, glm::vec3 &aabbMin, glm::vec3 &aabbMax) {
+    aabbMin = glm::vec3(0.f);
+    aabbMax = glm::vec3(0.f);
+
+    if (nrOfVertices == 0)
+        return;
+
+    aabbMin = vertices[0].position;
+    aabbMax = vertices[0].position;
+
+    for (size_t i = 1; i < nrOfVertices; i++) {
+        aabbMin = glm::min(aabbMin, vertices[i].position);
+        aabbMax = glm::max(aabbMax, vertices[i].position);
+    }
+}
+
+// True when the box lies entirely outside one of the clip planes of the given Model-View-Projection.
+static bool isOutsideFrustum(const glm::vec3 &aabbMin, const glm::vec3 &aabbMax, const glm::mat4 &MVP) {
+    glm::vec4 corners[8];
+
+    for (int i = 0; i < 8; i++) {
+        corners[i] = MVP * glm::vec4(
+                (i & 1) ? aabbMax.x : aabbMin.x,
+                (i & 2) ? aabbMax.y : aabbMin.y,
+                (i & 4) ? aabbMax.z : aabbMin.z,
+                1.f);
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        bool allBelow = true;
+        bool allAbove = true;
+
+        for (auto &corner : corners) {
+            allBelow = allBelow && corner[axis] < -corner.w;
+            allAbove = allAbove && corner[axis] > corner.w;
+        }
+
+        if (allBelow || allAbove)
+            return true;
+    }
+
+    return false;
+}
+
+#endif //OPENGL_5_AXIS_MESHLET_H
@@ -6,6 +6,10 @@
 #include "shader.h"
 #include "material.h"
 #include "objectLoader.h"
+#include "meshOptimizer.h"
+
+#include <algorithm>
+#include <map>
 
 class Model {
 private:
@@ -14,6 +18,9 @@ private:
 
     glm::vec3 position{};
 
+    //Written to the coverage attachment, so contacts can be traced back to the body
+    GLuint bodyId = 1;
+
 public:
     std::vector<Mesh *> meshes;
 
@@ -48,13 +55,23 @@ public:
         this->material = material;
 
 
-        std::vector<Vertex> mesh = loadObjFile(objFile);
+        //OBJ faces come back as one vertex per corner; weld them and order the triangles for the GPU
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        weldVertices(loadObjFile(objFile), vertices, indices);
+
+        float loadedMissRatio = averageCacheMissRatio(indices, vertices.size());
+        optimizeMesh(vertices, indices);
+
+        std::cout << "Welded to " << vertices.size() << " vertices, vertex cache misses per triangle "
+                  << loadedMissRatio << " -> " << averageCacheMissRatio(indices, vertices.size()) << std::endl;
+
         this->meshes.push_back(
                 new Mesh(
-                        mesh.data(),
-                        mesh.size(),
-                        nullptr,
-                        0, glm::vec3(0.f)));
+                        vertices.data(),
+                        vertices.size(),
+                        indices.data(),
+                        indices.size(), glm::vec3(0.f)));
 
         for (auto &i : this->meshes) {
             i->move(this->position);
@@ -70,6 +87,65 @@ public:
             delete i;
     }
 
+    //Accessors
+    glm::vec3 getPosition() const {
+        return this->position;
+    }
+
+    GLuint getBodyId() const {
+        return this->bodyId;
+    }
+
+    //Modifiers
+    void setBodyId(GLuint id) {
+        this->bodyId = id;
+    }
+
+    //Widens [nearest, farthest] to cover the view distance (-z) of every mesh's bounding box
+    void expandDepthRange(const glm::mat4 &ViewMatrix, float &nearest, float &farthest) const {
+        for (auto &i : this->meshes) {
+            glm::mat4 ModelViewMatrix = ViewMatrix * i->getModelMatrix();
+            glm::vec3 aabbMin = i->getAabbMin();
+            glm::vec3 aabbMax = i->getAabbMax();
+
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec4 viewPosition = ModelViewMatrix * glm::vec4((corner & 1) ? aabbMax.x : aabbMin.x,
+                                                                     (corner & 2) ? aabbMax.y : aabbMin.y,
+                                                                     (corner & 4) ? aabbMax.z : aabbMin.z,
+                                                                     1.f);
+                nearest = std::min(nearest, -viewPosition.z);
+                farthest = std::max(farthest, -viewPosition.z);
+            }
+        }
+    }
+
+    //Widens [low, high] to cover the normalised device xy of every mesh's bounding box; a corner
+    //behind a perspective camera widens it to the whole screen
+    void expandClipBounds(const glm::mat4 &ViewProjectionMatrix, glm::vec2 &low, glm::vec2 &high) const {
+        for (auto &i : this->meshes) {
+            glm::mat4 MVP = ViewProjectionMatrix * i->getModelMatrix();
+            glm::vec3 aabbMin = i->getAabbMin();
+            glm::vec3 aabbMax = i->getAabbMax();
+
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec4 clipPosition = MVP * glm::vec4((corner & 1) ? aabbMax.x : aabbMin.x,
+                                                         (corner & 2) ? aabbMax.y : aabbMin.y,
+                                                         (corner & 4) ? aabbMax.z : aabbMin.z,
+                                                         1.f);
+
+                if (clipPosition.w <= 0.f) {
+                    low = glm::min(low, glm::vec2(-1.f));
+                    high = glm::max(high, glm::vec2(1.f));
+                    continue;
+                }
+
+                glm::vec2 device(clipPosition.x / clipPosition.w, clipPosition.y / clipPosition.w);
+                low = glm::min(low, device);
+                high = glm::max(high, device);
+            }
+        }
+    }
+
     //Functions
     void rotate(const glm::vec3 rotation) {
         for (auto &i : this->meshes)
@@ -77,6 +153,8 @@ public:
     }
 
     void move(const glm::vec3 direction) {
+        this->position += direction;
+
         for (auto &i : this->meshes)
             i->move(direction);
     }
@@ -86,6 +164,14 @@ public:
             i->scaleUp(scale);
     }
 
+    //Takes over the rotation and scale of another model of the same shape, e.g. another level of detail
+    void matchOrientation(const Model &other) {
+        for (size_t i = 0; i < this->meshes.size() && i < other.meshes.size(); i++) {
+            this->meshes[i]->setRotation(other.meshes[i]->getRotation());
+            this->meshes[i]->setScale(other.meshes[i]->getScale());
+        }
+    }
+
     void update() {
     }
 
@@ -95,6 +181,7 @@ public:
 
         //Update uniforms
         this->material->sendToShader(*shader);
+        shader->set1ui(this->bodyId, "bodyId");
 
         //Use a program
         shader->use();
@@ -106,6 +193,37 @@ public:
             i->render(shader);
         }
     }
+
+    //Same as render, but meshes and meshlets outside the View-Projection frustum are skipped on the CPU
+    void render(Shader *shader, const glm::mat4 &ViewProjectionMatrix) {
+        this->updateUniforms();
+
+        this->material->sendToShader(*shader);
+        shader->set1ui(this->bodyId, "bodyId");
+
+        shader->use();
+
+        for (auto &i : this->meshes) {
+            i->render(shader, ViewProjectionMatrix);
+        }
+    }
+
+    //Same, from a context other than the one the meshes were made in; vertexArrays holds that
+    //context's vertex array per mesh and is filled on first use
+    void render(Shader *shader, const glm::mat4 &ViewProjectionMatrix, std::map<const Mesh *, GLuint> &vertexArrays) {
+        this->material->sendToShader(*shader);
+        shader->set1ui(this->bodyId, "bodyId");
+
+        shader->use();
+
+        for (auto &i : this->meshes) {
+            auto vertexArray = vertexArrays.find(i);
+            if (vertexArray == vertexArrays.end())
+                vertexArray = vertexArrays.emplace(i, i->createVertexArray()).first;
+
+            i->render(shader, ViewProjectionMatrix, vertexArray->second);
+        }
+    }
 };
 
 
@@ -0,0 +1,152 @@
+#ifndef OPENGL_5_AXIS_NURBS_H
+#define OPENGL_5_AXIS_NURBS_H
+
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Highest patch degree accepted; CAD exports rarely go past 7, and the basis scratch arrays are
+// sized by it
+const int NURBS_MAX_DEGREE = 15;
+
+// Rational B-spline patch of any degree. Control points are (x, y, z, weight), countU * countV of
+// them with v varying fastest; each direction has count + degree + 1 non-decreasing knots.
+struct NurbsPatch {
+    int degreeU;
+    int degreeV;
+    int countU;
+    int countV;
+    std::vector<float> knotsU;
+    std::vector<float> knotsV;
+    std::vector<glm::vec4> controlPoints;
+
+    bool isValid() const {
+        if (degreeU < 1 || degreeV < 1 || degreeU > NURBS_MAX_DEGREE || degreeV > NURBS_MAX_DEGREE)
+            return false;
+        if (countU <= degreeU || countV <= degreeV)
+            return false;
+        if (knotsU.size() != size_t(countU + degreeU + 1) || knotsV.size() != size_t(countV + degreeV + 1))
+            return false;
+        if (controlPoints.size() != size_t(countU) * countV)
+            return false;
+        if (!std::is_sorted(knotsU.begin(), knotsU.end()) || !std::is_sorted(knotsV.begin(), knotsV.end()))
+            return false;
+        for (auto &point : controlPoints)
+            if (!(point.w > 0.f))
+                return false;
+
+        //The parameter range [knots[degree], knots[count]] must not be empty
+        return knotsU[countU] > knotsU[degreeU] && knotsV[countV] > knotsV[degreeV];
+    }
+
+    const glm::vec4 &controlPoint(int i, int j) const {
+        return controlPoints[size_t(i) * countV + j];
+    }
+};
+
+// Knot span index s with knots[s] <= t < knots[s + 1], t clamped to the parameter range; the end
+// of the range belongs to the last non-empty span
+static int findKnotSpan(const std::vector<float> &knots, int degree, int count, float t) {
+    t = std::clamp(t, knots[degree], knots[count]);
+
+    int span = int(std::upper_bound(knots.begin() + degree, knots.begin() + count, t) - knots.begin()) - 1;
+    while (span > degree && knots[span] == knots[span + 1])
+        span--;
+
+    return span;
+}
+
+// The degree + 1 basis functions that are non-zero on the given span, by the Cox-de Boor
+// triangle (Piegl & Tiller, algorithm A2.2); basis[k] belongs to control point span - degree + k.
+// degree must not exceed NURBS_MAX_DEGREE.
+static void basisFunctions(const std::vector<float> &knots, int degree, int span, float t, float *basis) {
+    float left[NURBS_MAX_DEGREE + 1], right[NURBS_MAX_DEGREE + 1];
+
+    basis[0] = 1.f;
+    for (int j = 1; j <= degree; j++) {
+        left[j] = t - knots[span + 1 - j];
+        right[j] = knots[span + j] - t;
+
+        float saved = 0.f;
+        for (int r = 0; r < j; r++) {
+            float temp = basis[r] / (right[r + 1] + left[j - r]);
+            basis[r] = saved + right[r + 1] * temp;
+            saved = left[j - r] * temp;
+        }
+        basis[j] = saved;
+    }
+}
+
+// Spans and basis values for every sample of one parameter direction. A grid sample needs the
+// basis of its u line and its v line only, so they are computed once per line instead of once
+// per point; evaluating the grid is then a plain weighted sum of control points.
+struct NurbsBasisLine {
+    int degree;
+    std::vector<int> spans;
+    std::vector<float> basis;
+
+    NurbsBasisLine(const std::vector<float> &knots, int degree, int count, int divisions)
+            : degree(degree), spans(divisions + 1), basis(size_t(divisions + 1) * (degree + 1)) {
+        float first = knots[degree], last = knots[count];
+
+        for (int k = 0; k <= divisions; k++) {
+            float t = k == divisions ? last : first + (last - first) * float(k) / float(divisions);
+
+            this->spans[k] = findKnotSpan(knots, degree, count, t);
+            basisFunctions(knots, degree, this->spans[k], t, this->basis.data() + size_t(k) * (degree + 1));
+        }
+    }
+
+    const float *at(int k) const {
+        return this->basis.data() + size_t(k) * (this->degree + 1);
+    }
+};
+
+// Point of the patch at sample (k, l) of the two basis lines
+static glm::vec3 evaluateNurbsPoint(const NurbsPatch &patch, const NurbsBasisLine &lineU, int k,
+                                    const NurbsBasisLine &lineV, int l) {
+    const float *basisU = lineU.at(k);
+    const float *basisV = lineV.at(l);
+    int firstU = lineU.spans[k] - patch.degreeU;
+    int firstV = lineV.spans[l] - patch.degreeV;
+
+    //Sum in homogeneous coordinates, then project
+    glm::vec4 point(0.f);
+    for (int i = 0; i <= patch.degreeU; i++) {
+        glm::vec4 row(0.f);
+        for (int j = 0; j <= patch.degreeV; j++) {
+            const glm::vec4 &control = patch.controlPoint(firstU + i, firstV + j);
+            row += basisV[j] * glm::vec4(glm::vec3(control) * control.w, control.w);
+        }
+        point += basisU[i] * row;
+    }
+
+    return glm::vec3(point) / point.w;
+}
+
+// Length of the longest control polygon line running along u (alongU) or v; a bound on the
+// length of the iso-curves, used to pick the tessellation density
+static float controlPolygonLength(const NurbsPatch &patch, bool alongU) {
+    int lines = alongU ? patch.countV : patch.countU;
+    int points = alongU ? patch.countU : patch.countV;
+    float longest = 0.f;
+
+    for (int line = 0; line < lines; line++) {
+        float length = 0.f;
+        for (int k = 1; k < points; k++) {
+            glm::vec3 a(alongU ? patch.controlPoint(k - 1, line) : patch.controlPoint(line, k - 1));
+            glm::vec3 b(alongU ? patch.controlPoint(k, line) : patch.controlPoint(line, k));
+            length += glm::length(b - a);
+        }
+        longest = std::max(longest, length);
+    }
+
+    return longest;
+}
+
+#endif //OPENGL_5_AXIS_NURBS_H
@@ -21,6 +21,8 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "vertex.h"
+#include "nurbs.h"
+#include "stlFile.h"
 
 static std::vector<Vertex> loadObjFile(const char *filename) {
     std::vector<glm::fvec3> vertexPositions;
@@ -124,6 +126,107 @@ static std::vector<Vertex> loadObjFile(const char *filename) {
     return vertices;
 }
 
+// Tool origins of a toolpath, one "x y z" per line; empty lines and lines starting with # are skipped
+static std::vector<glm::vec3> loadToolpath(const char *filename) {
+    std::vector<glm::vec3> toolpath;
+
+    std::stringstream ss;
+    std::ifstream inputFile(filename);
+    std::string currentLine;
+
+    glm::vec3 temp_vec3;
+
+    if (!inputFile.is_open()) {
+        std::cout << "Failed to load toolpath : " << filename << std::endl;
+        std::cout << "ERROR::OBJLOADER::COULD_NOT_OPEN_FILE" << std::endl;
+        return toolpath;
+    }
+
+    while (std::getline(inputFile, currentLine)) {
+        ss.clear();
+        ss.str(currentLine);
+
+        if (currentLine.empty() || currentLine[0] == '#')
+            continue;
+
+        if (ss >> temp_vec3.x >> temp_vec3.y >> temp_vec3.z)
+            toolpath.push_back(temp_vec3);
+    }
+
+    std::cout << "Toolpath \"" << filename << "\" loaded, " << toolpath.size() << " points" << std::endl;
+    return toolpath;
+}
+
+// Workpiece surface as NURBS patches, text exported from CAD. Lines starting with # are skipped.
+// Every patch is
+//     patch <degree u> <degree v> <count u> <count v>
+//     knots_u <count u + degree u + 1 knots>
+//     knots_v <count v + degree v + 1 knots>
+// followed by count u * count v lines "cp x y z [w]", v varying fastest; w defaults to 1.
+// Malformed patches are reported and skipped.
+static std::vector<NurbsPatch> loadNurbsPatches(const char *filename) {
+    std::vector<NurbsPatch> patches;
+
+    std::stringstream ss;
+    std::ifstream inputFile(filename);
+    std::string currentLine;
+    std::string prefix;
+
+    size_t skipped = 0;
+    float value;
+
+    if (!inputFile.is_open()) {
+        std::cout << "Failed to load NURBS file : " << filename << std::endl;
+        std::cout << "ERROR::OBJLOADER::COULD_NOT_OPEN_FILE" << std::endl;
+        return patches;
+    }
+
+    auto finish = [&]() {
+        if (patches.empty() || patches.back().isValid())
+            return;
+
+        std::cout << "ERROR::OBJLOADER::INVALID_NURBS_PATCH: " << patches.size() - 1 + skipped << "\n";
+        patches.pop_back();
+        skipped++;
+    };
+
+    while (std::getline(inputFile, currentLine)) {
+        ss.clear();
+        ss.str(currentLine);
+
+        if (currentLine.empty() || currentLine[0] == '#' || !(ss >> prefix))
+            continue;
+
+        if (prefix == "patch") {
+            finish();
+
+            NurbsPatch patch{};
+            //The counts are not trusted for sizing; isValid checks them against what the file holds
+            ss >> patch.degreeU >> patch.degreeV >> patch.countU >> patch.countV;
+            patches.push_back(std::move(patch));
+        } else if (patches.empty()) {
+            continue;
+        } else if (prefix == "knots_u") {
+            while (ss >> value)
+                patches.back().knotsU.push_back(value);
+        } else if (prefix == "knots_v") {
+            while (ss >> value)
+                patches.back().knotsV.push_back(value);
+        } else if (prefix == "cp") {
+            glm::vec4 point(0.f, 0.f, 0.f, 1.f);
+            ss >> point.x >> point.y >> point.z;
+            if (ss >> value)
+                point.w = value;
+            patches.back().controlPoints.push_back(point);
+        }
+    }
+
+    finish();
+
+    std::cout << "NURBS file \"" << filename << "\" loaded, " << patches.size() << " patches" << std::endl;
+    return patches;
+}
+
 static void print(char *stuff) {
     std::cout << stuff << std::endl;
 }
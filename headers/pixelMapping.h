@@ -0,0 +1,109 @@
+#ifndef OPENGL_5_AXIS_PIXELMAPPING_H
+#define OPENGL_5_AXIS_PIXELMAPPING_H
+
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/vec2.hpp>
+
+// Exact pixel <-> view-space mapping of an ortho window rendered at width x height. Pixel (column, row)
+// covers [left + column * pixelWidth, left + (column + 1) * pixelWidth) horizontally, and likewise
+// vertically with rows bottom first, as glReadPixels returns them. Index is row * width + column.
+class PixelMapping {
+private:
+    float left;
+    float right;
+    float bottom;
+    float top;
+    int width;
+    int height;
+
+public:
+    PixelMapping(float left, float right, float bottom, float top, int width, int height)
+            : left(left), right(right), bottom(bottom), top(top), width(width), height(height) {
+    }
+
+    // Window with square pixels centred on the box [low, high], just large enough that the box leaves
+    // marginPixels background pixels on the tighter axis
+    static PixelMapping fitted(glm::vec2 low, glm::vec2 high, int width, int height, int marginPixels) {
+        float pixel = std::max((high.x - low.x) / float(std::max(1, width - 2 * marginPixels)),
+                               (high.y - low.y) / float(std::max(1, height - 2 * marginPixels)));
+        float halfWidth = 0.5f * pixel * float(width);
+        float halfHeight = 0.5f * pixel * float(height);
+        glm::vec2 centre = 0.5f * (low + high);
+
+        return PixelMapping(centre.x - halfWidth, centre.x + halfWidth, centre.y - halfHeight, centre.y + halfHeight,
+                            width, height);
+    }
+
+    // Window with square pixels centred on centre, just large enough that a disc of the given radius
+    // leaves marginPixels background pixels on the tighter axis
+    static PixelMapping fitted(glm::vec2 centre, float radius, int width, int height, int marginPixels) {
+        return fitted(centre - glm::vec2(radius), centre + glm::vec2(radius), width, height, marginPixels);
+    }
+
+    //Accessors
+    float getLeft() const {
+        return this->left;
+    }
+
+    float getRight() const {
+        return this->right;
+    }
+
+    float getBottom() const {
+        return this->bottom;
+    }
+
+    float getTop() const {
+        return this->top;
+    }
+
+    int getWidth() const {
+        return this->width;
+    }
+
+    int getHeight() const {
+        return this->height;
+    }
+
+    float getPixelWidth() const {
+        return (this->right - this->left) / float(this->width);
+    }
+
+    float getPixelHeight() const {
+        return (this->top - this->bottom) / float(this->height);
+    }
+
+    glm::vec2 getCentre() const {
+        return glm::vec2(0.5f * (this->left + this->right), 0.5f * (this->bottom + this->top));
+    }
+
+    //Functions
+    glm::vec2 pixelCentre(int column, int row) const {
+        return glm::vec2(this->left + (float(column) + 0.5f) * this->getPixelWidth(),
+                         this->bottom + (float(row) + 0.5f) * this->getPixelHeight());
+    }
+
+    glm::vec2 pixelCentre(long index) const {
+        return this->pixelCentre(int(index % this->width), int(index / this->width));
+    }
+
+    // Pixel containing point; false when it is outside the window
+    bool pixelAt(glm::vec2 point, int &column, int &row) const {
+        column = int(std::floor((point.x - this->left) / this->getPixelWidth()));
+        row = int(std::floor((point.y - this->bottom) / this->getPixelHeight()));
+
+        return column >= 0 && column < this->width && row >= 0 && row < this->height;
+    }
+
+    // Index of the pixel containing point, -1 outside the window
+    long pixelIndex(glm::vec2 point) const {
+        int column, row;
+        return this->pixelAt(point, column, row) ? long(row) * this->width + column : -1;
+    }
+};
+
+#endif //OPENGL_5_AXIS_PIXELMAPPING_H
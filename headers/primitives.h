@@ -207,4 +207,34 @@ public:
     }
 };
 
+// Axis-aligned box between two corners, e.g. a fixture clamp
+class Box : public Primitive {
+public:
+    Box(glm::vec3 min, glm::vec3 max)
+            : Primitive() {
+        Vertex vertices[8];
+
+        for (int i = 0; i < 8; i++) {
+            vertices[i].position = glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+            vertices[i].color = glm::vec3(1.f);
+            vertices[i].texcoord = glm::vec2(0.f, 1.f);
+            vertices[i].normal = glm::normalize(vertices[i].position - 0.5f * (min + max));
+        }
+        unsigned nrOfVertices = sizeof(vertices) / sizeof(Vertex);
+
+        GLuint indices[] =
+                {
+                        0, 2, 3, 0, 3, 1,   //Bottom
+                        4, 5, 7, 4, 7, 6,   //Top
+                        0, 1, 5, 0, 5, 4,   //Front
+                        2, 6, 7, 2, 7, 3,   //Back
+                        0, 4, 6, 0, 6, 2,   //Left
+                        1, 3, 7, 1, 7, 5    //Right
+                };
+        unsigned nrOfIndices = sizeof(indices) / sizeof(GLuint);
+
+        this->set(vertices, nrOfVertices, indices, nrOfIndices);
+    }
+};
+
 #endif //OPENGL_5_AXIS_PRIMITIVES_H
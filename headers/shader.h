@@ -5,6 +5,10 @@
 #include<iostream>
 #include<fstream>
 #include<string>
+#include<vector>
+#include<cstdio>
+#include<cstdint>
+#include<filesystem>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -18,6 +22,18 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+// Linked programs are stored here by glGetProgramBinary and reloaded on the next start
+const char *const SHADER_CACHE_DIR = "shader_cache";
+
+// 64-bit FNV-1a; stable across runs and platforms, unlike std::hash
+static uint64_t hashString(const std::string &text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 class Shader {
 private:
     //Member variables
@@ -26,7 +42,7 @@ private:
     const int versionMinor;
 
     //Private functions
-    std::string loadShaderSource(char *fileName) const {
+    std::string loadShaderSource(char *fileName, const std::vector<std::string> &defines) const {
         std::string temp;
         std::string src;
 
@@ -51,15 +67,25 @@ private:
 
         src.replace(src.find("#version"), 12, ("#version " + versionNr));
 
+        //Feature flags of this permutation go right after #version, the only line allowed before them;
+        //#line keeps compiler messages pointing at the lines of the file
+        if (!defines.empty()) {
+            std::string flags;
+            for (auto &define : defines)
+                flags += "#define " + define + "\n";
+            flags += "#line 2\n";
+
+            src.insert(src.find('\n', src.find("#version")) + 1, flags);
+        }
+
         return src;
     }
 
-    GLuint loadShader(GLenum type, char *fileName) {
+    GLuint loadShader(GLenum type, const std::string &str_src, char *fileName) {
         char infoLog[512];
         GLint success;
 
         GLuint shader = glCreateShader(type);
-        std::string str_src = this->loadShaderSource(fileName);
         const GLchar *src = str_src.c_str();
         glShaderSource(shader, 1, &src, nullptr);
         glCompileShader(shader);
@@ -87,6 +113,9 @@ private:
 
         glAttachShader(this->id, fragmentShader);
 
+        if (Shader::binaryCacheSupported())
+            glProgramParameteri(this->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
         glLinkProgram(this->id);
 
         glGetProgramiv(this->id, GL_LINK_STATUS, &success);
@@ -99,25 +128,125 @@ private:
         glUseProgram(0);
     }
 
+    static bool binaryCacheSupported() {
+        return GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary;
+    }
+
+    // Binaries are only valid for the driver that produced them, so the key covers the driver
+    // strings as well as the preprocessed sources
+    static std::string cacheFile(const std::vector<std::string> &sources) {
+        std::string driver;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const GLubyte *value = glGetString(name);
+            driver += value ? reinterpret_cast<const char *>(value) : "";
+            driver += "\n";
+        }
+
+        uint64_t hash = hashString(driver);
+        for (auto &source : sources)
+            hash = hashString(source, hashString("\n", hash));
+
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+
+        return (std::filesystem::path(SHADER_CACHE_DIR) / (std::string(name) + ".bin")).string();
+    }
+
+    // File layout: binary format (GLenum), then the binary itself
+    bool loadProgramBinary(const std::string &fileName) {
+        std::ifstream in_file(fileName, std::ios::binary);
+        if (!in_file.is_open())
+            return false;
+
+        GLenum format;
+        if (!in_file.read(reinterpret_cast<char *>(&format), sizeof(format)))
+            return false;
+
+        std::vector<char> binary((std::istreambuf_iterator<char>(in_file)), std::istreambuf_iterator<char>());
+        if (binary.empty())
+            return false;
+
+        this->id = glCreateProgram();
+        glProgramBinary(this->id, format, binary.data(), GLsizei(binary.size()));
+
+        //A driver update invalidates stored binaries; the caller then compiles from source
+        GLint success;
+        glGetProgramiv(this->id, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(this->id);
+            this->id = 0;
+            return false;
+        }
+
+        return true;
+    }
+
+    void saveProgramBinary(const std::string &fileName) const {
+        GLint success;
+        glGetProgramiv(this->id, GL_LINK_STATUS, &success);
+
+        GLint length = 0;
+        glGetProgramiv(this->id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0)
+            return;
+
+        GLenum format;
+        std::vector<char> binary(length);
+        glGetProgramBinary(this->id, length, nullptr, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+
+        std::ofstream out_file(fileName, std::ios::binary);
+        if (!out_file.is_open()) {
+            std::cout << "ERROR::SHADER::COULD_NOT_WRITE_CACHE: " << fileName << "\n";
+            return;
+        }
+
+        out_file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+        out_file.write(binary.data(), length);
+    }
+
 public:
 
     //Constructors/Destructors
+
+    //defines are the feature flags of the permutation, defined in every stage; each permutation is
+    //compiled and cached on its own
     Shader(const int versionMajor, const int versionMinor,
-           char *vertexFile, char *fragmentFile, char *geometryFile = (char *) "")
+           char *vertexFile, char *fragmentFile, char *geometryFile = (char *) "",
+           const std::vector<std::string> &defines = {})
             : versionMajor(versionMajor), versionMinor(versionMinor) {
         GLuint vertexShader = 0;
         GLuint geometryShader = 0;
         GLuint fragmentShader = 0;
 
-        vertexShader = loadShader(GL_VERTEX_SHADER, vertexFile);
+        bool hasGeometry = std::string(geometryFile) != "";
+
+        std::string vertexSource = this->loadShaderSource(vertexFile, defines);
+        std::string geometrySource = hasGeometry ? this->loadShaderSource(geometryFile, defines) : "";
+        std::string fragmentSource = this->loadShaderSource(fragmentFile, defines);
+
+        //Reuse the program linked by an earlier run when sources and driver are unchanged
+        std::string cached;
+        if (Shader::binaryCacheSupported()) {
+            cached = Shader::cacheFile({vertexSource, geometrySource, fragmentSource});
+            if (this->loadProgramBinary(cached))
+                return;
+        }
+
+        vertexShader = loadShader(GL_VERTEX_SHADER, vertexSource, vertexFile);
 
-        if (geometryFile != "")
-            geometryShader = loadShader(GL_GEOMETRY_SHADER, geometryFile);
+        if (hasGeometry)
+            geometryShader = loadShader(GL_GEOMETRY_SHADER, geometrySource, geometryFile);
 
-        fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentFile);
+        fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentSource, fragmentFile);
 
         this->linkProgram(vertexShader, geometryShader, fragmentShader);
 
+        if (!cached.empty())
+            this->saveProgramBinary(cached);
+
         //End
         glDeleteShader(vertexShader);
         glDeleteShader(geometryShader);
@@ -145,6 +274,14 @@ public:
         Shader::unuse();
     }
 
+    void set1ui(GLuint value, const GLchar *name) const {
+        this->use();
+
+        glUniform1ui(glGetUniformLocation(this->id, name), value);
+
+        Shader::unuse();
+    }
+
     void set1f(GLfloat value, const GLchar *name) const {
         this->use();
 
@@ -0,0 +1,310 @@
+#ifndef OPENGL_5_AXIS_STLFILE_H
+#define OPENGL_5_AXIS_STLFILE_H
+
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+#include "vertex.h"
+
+// Binary STL: 80-byte header, uint32 triangle count, then one packed 50-byte record per triangle
+// (normal, three corners as little-endian float32 triples, uint16 attribute count)
+const size_t STL_HEADER_BYTES = 80;
+const size_t STL_RECORD_BYTES = 50;
+
+// Fewest triangles per thread when reading or writing; smaller files use the calling thread only
+const size_t STL_MIN_TRIANGLES_PER_THREAD = 16384;
+
+// Read-only memory map of a whole file
+class MappedFile {
+private:
+    const unsigned char *data;
+    size_t size;
+
+public:
+    explicit MappedFile(const char *fileName) : data(nullptr), size(0) {
+        int descriptor = open(fileName, O_RDONLY);
+        if (descriptor < 0)
+            return;
+
+        struct stat status{};
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            void *mapped = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapped != MAP_FAILED) {
+                this->data = static_cast<const unsigned char *>(mapped);
+                this->size = size_t(status.st_size);
+                madvise(mapped, this->size, MADV_SEQUENTIAL);
+            }
+        }
+
+        //The mapping stays valid once the descriptor is closed
+        close(descriptor);
+    }
+
+    ~MappedFile() {
+        if (this->data)
+            munmap(const_cast<unsigned char *>(this->data), this->size);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    //Accessors
+    bool isOpen() const {
+        return this->data != nullptr;
+    }
+
+    const unsigned char *getData() const {
+        return this->data;
+    }
+
+    size_t getSize() const {
+        return this->size;
+    }
+};
+
+// Runs work(first, last) over [0, count) split into one contiguous share per thread
+template<typename Work>
+static void forEachStlShare(size_t count, const Work &work) {
+    size_t threads = std::max(size_t(1), std::min(size_t(std::thread::hardware_concurrency()),
+                                                  count / STL_MIN_TRIANGLES_PER_THREAD));
+    size_t share = (count + threads - 1) / threads;
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+        workers.emplace_back(work, std::min(t * share, count), std::min((t + 1) * share, count));
+
+    work(0, std::min(share, count));
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+// Bit pattern of a corner, with -0 folded into +0 so both weld together
+struct StlCornerKey {
+    uint32_t bits[3];
+
+    explicit StlCornerKey(const glm::vec3 &position) : bits{} {
+        for (int k = 0; k < 3; k++) {
+            float value = position[k] + 0.f;
+            std::memcpy(&this->bits[k], &value, sizeof(float));
+        }
+    }
+
+    bool operator==(const StlCornerKey &other) const {
+        return this->bits[0] == other.bits[0] && this->bits[1] == other.bits[1] && this->bits[2] == other.bits[2];
+    }
+
+    size_t hash() const {
+        uint64_t hash = (uint64_t(this->bits[0]) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(this->bits[1]) * 0xC2B2AE3D27D4EB4Full);
+        hash ^= uint64_t(this->bits[2]) * 0x165667B19E3779F9ull;
+        return size_t(hash ^ (hash >> 29));
+    }
+};
+
+// Indexed mesh from a binary STL file, read straight from a memory map. Corners with identical
+// coordinates are welded into one vertex: corners are partitioned by hash into one bucket per
+// thread, every thread welds its own bucket to the first corner of each position with a flat
+// open-addressing table, and a final ordered pass numbers the vertices in the order they first
+// appear in the file. Vertex normals are the average of the facet normals of their triangles. All
+// arrays are sized once up front, so nothing is allocated per triangle or per vertex. Returns false
+// when the file cannot be read as binary STL.
+static bool loadStlFile(const char *fileName, std::vector<Vertex> &vertices, std::vector<GLuint> &indices) {
+    vertices.clear();
+    indices.clear();
+
+    MappedFile file(fileName);
+    if (!file.isOpen()) {
+        std::cout << "Failed to load STL file : " << fileName << std::endl;
+        std::cout << "ERROR::STLFILE::COULD_NOT_OPEN_FILE" << std::endl;
+        return false;
+    }
+
+    uint32_t triangleCount = 0;
+    if (file.getSize() >= STL_HEADER_BYTES + sizeof(uint32_t))
+        std::memcpy(&triangleCount, file.getData() + STL_HEADER_BYTES, sizeof(uint32_t));
+
+    //ASCII files, which also start with "solid", never match the binary size exactly
+    if (file.getSize() != STL_HEADER_BYTES + sizeof(uint32_t) + size_t(triangleCount) * STL_RECORD_BYTES) {
+        std::cout << "ERROR::STLFILE::NOT_BINARY_STL: " << fileName << "\n";
+        return false;
+    }
+
+    const unsigned char *records = file.getData() + STL_HEADER_BYTES + sizeof(uint32_t);
+    const size_t cornerCount = size_t(triangleCount) * 3;
+
+    size_t buckets = std::max(size_t(1), std::min(size_t(std::thread::hardware_concurrency()),
+                                                  size_t(triangleCount) / STL_MIN_TRIANGLES_PER_THREAD));
+
+    //Facet normals, corner positions and their weld buckets; records are packed, so they are copied
+    //out rather than cast
+    std::vector<glm::vec3> facetNormals(triangleCount);
+    std::vector<glm::vec3> corners(cornerCount);
+    std::vector<uint32_t> bucketOf(cornerCount);
+    forEachStlShare(triangleCount, [&](size_t first, size_t last) {
+        for (size_t t = first; t < last; t++) {
+            std::memcpy(&facetNormals[t], records + t * STL_RECORD_BYTES, 3 * sizeof(float));
+            std::memcpy(&corners[t * 3], records + t * STL_RECORD_BYTES + 3 * sizeof(float), 9 * sizeof(float));
+            for (size_t c = t * 3; c < t * 3 + 3; c++)
+                bucketOf[c] = uint32_t(StlCornerKey(corners[c]).hash() % buckets);
+
+            //Some exporters leave the stored normal zero; the winding gives it instead
+            if (glm::dot(facetNormals[t], facetNormals[t]) == 0.f) {
+                glm::vec3 normal = glm::cross(corners[t * 3 + 1] - corners[t * 3], corners[t * 3 + 2] - corners[t * 3]);
+                float length = glm::length(normal);
+                facetNormals[t] = length > 0.f ? normal / length : glm::vec3(0.f);
+            }
+        }
+    });
+
+    //Stable counting sort of corner indices by bucket
+    std::vector<size_t> bucketFirst(buckets + 1, 0);
+    for (size_t c = 0; c < cornerCount; c++)
+        bucketFirst[bucketOf[c] + 1]++;
+    for (size_t b = 0; b < buckets; b++)
+        bucketFirst[b + 1] += bucketFirst[b];
+
+    std::vector<uint32_t> bucketCorners(cornerCount);
+    std::vector<size_t> bucketNext(bucketFirst.begin(), bucketFirst.end() - 1);
+    for (size_t c = 0; c < cornerCount; c++)
+        bucketCorners[bucketNext[bucketOf[c]]++] = uint32_t(c);
+
+    //Every corner points at the first corner with the same position. Each bucket gets a linear probing
+    //table of corner indices at most half full; the hash bits that chose the bucket are skipped.
+    const uint32_t emptySlot = uint32_t(-1);
+    std::vector<uint32_t> representative(cornerCount);
+    std::vector<size_t> bucketVertices(buckets, 0);
+    auto weldBucket = [&](size_t bucket) {
+        size_t slots = 1;
+        while (slots < 2 * (bucketFirst[bucket + 1] - bucketFirst[bucket]))
+            slots *= 2;
+        std::vector<uint32_t> table(slots, emptySlot);
+
+        for (size_t k = bucketFirst[bucket]; k < bucketFirst[bucket + 1]; k++) {
+            uint32_t c = bucketCorners[k];
+            StlCornerKey key(corners[c]);
+
+            size_t slot = (key.hash() / buckets) & (slots - 1);
+            while (table[slot] != emptySlot && !(StlCornerKey(corners[table[slot]]) == key))
+                slot = (slot + 1) & (slots - 1);
+
+            if (table[slot] == emptySlot) {
+                table[slot] = c;
+                bucketVertices[bucket]++;
+            }
+            representative[c] = table[slot];
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t b = 1; b < buckets; b++)
+        workers.emplace_back(weldBucket, b);
+
+    weldBucket(0);
+
+    for (auto &worker : workers)
+        worker.join();
+
+    size_t vertexCount = 0;
+    for (size_t count : bucketVertices)
+        vertexCount += count;
+
+    //Representatives come first in file order, so they are numbered before any corner refers to them
+    Vertex tempVertex{};
+    tempVertex.color = glm::vec3(1.f);
+    tempVertex.normal = glm::vec3(0.f);
+    tempVertex.texcoord = glm::vec2(0.f, 1.f);
+
+    vertices.assign(vertexCount, tempVertex);
+    indices.resize(cornerCount);
+    std::vector<GLuint> vertexOf(cornerCount);
+    GLuint nextVertex = 0;
+
+    for (size_t c = 0; c < cornerCount; c++) {
+        if (representative[c] == c) {
+            vertexOf[c] = nextVertex++;
+            vertices[vertexOf[c]].position = corners[c];
+        }
+        indices[c] = vertexOf[representative[c]];
+        vertices[indices[c]].normal += facetNormals[c / 3];
+    }
+
+    for (auto &vertex : vertices) {
+        float length = glm::length(vertex.normal);
+        vertex.normal = length > 0.f ? vertex.normal / length : glm::vec3(0.f, 0.f, 1.f);
+    }
+
+    std::cout << "STL file \"" << fileName << "\" loaded, " << triangleCount << " triangles, "
+              << vertices.size() << " vertices" << std::endl;
+    return true;
+}
+
+// Writes triangles (three indices each, or consecutive vertex triples when indices is null) as
+// binary STL, with every position transformed by ModelMatrix. Records are filled in parallel into
+// one buffer, which is then written with a single call.
+static bool saveStlFile(const char *fileName, const Vertex *vertices, const GLuint *indices, size_t nrOfCorners,
+                        const glm::mat4 &ModelMatrix = glm::mat4(1.f)) {
+    const size_t triangleCount = nrOfCorners / 3;
+    std::vector<unsigned char> buffer(STL_HEADER_BYTES + sizeof(uint32_t) + triangleCount * STL_RECORD_BYTES, 0);
+
+    const char header[] = "binary STL";
+    std::memcpy(buffer.data(), header, sizeof(header));
+    uint32_t count = uint32_t(triangleCount);
+    std::memcpy(buffer.data() + STL_HEADER_BYTES, &count, sizeof(count));
+
+    unsigned char *records = buffer.data() + STL_HEADER_BYTES + sizeof(uint32_t);
+
+    forEachStlShare(triangleCount, [&](size_t first, size_t last) {
+        float values[12];
+
+        for (size_t t = first; t < last; t++) {
+            glm::vec3 corner[3];
+            for (int k = 0; k < 3; k++) {
+                size_t c = t * 3 + k;
+                corner[k] = glm::vec3(ModelMatrix * glm::vec4(vertices[indices ? indices[c] : c].position, 1.f));
+            }
+
+            glm::vec3 normal = glm::cross(corner[1] - corner[0], corner[2] - corner[0]);
+            float length = glm::length(normal);
+            normal = length > 0.f ? normal / length : glm::vec3(0.f);
+
+            for (int k = 0; k < 3; k++) {
+                values[k] = normal[k];
+                values[3 + k] = corner[0][k];
+                values[6 + k] = corner[1][k];
+                values[9 + k] = corner[2][k];
+            }
+
+            //The trailing attribute byte count stays 0 from the buffer initialisation
+            std::memcpy(records + t * STL_RECORD_BYTES, values, sizeof(values));
+        }
+    });
+
+    std::ofstream out_file(fileName, std::ios::binary);
+    if (!out_file.is_open()) {
+        std::cout << "ERROR::STLFILE::COULD_NOT_WRITE_FILE: " << fileName << "\n";
+        return false;
+    }
+
+    out_file.write(reinterpret_cast<const char *>(buffer.data()), std::streamsize(buffer.size()));
+
+    std::cout << "STL file \"" << fileName << "\" written, " << triangleCount << " triangles" << std::endl;
+    return bool(out_file);
+}
+
+#endif //OPENGL_5_AXIS_STLFILE_H
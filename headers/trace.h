@@ -0,0 +1,175 @@
+#ifndef OPENGL_5_AXIS_TRACE_H
+#define OPENGL_5_AXIS_TRACE_H
+
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+// Events kept before the oldest ones are overwritten
+const size_t TRACE_CAPACITY = 4096;
+
+struct TraceEvent {
+    const char *name;
+    double cpuStart;
+    double cpuDuration;
+    int depth;
+};
+
+// Records CPU time and a pair of GL_TIMESTAMP queries per stage into a fixed ring buffer.
+// Timestamps (rather than GL_TIME_ELAPSED) are used so stages can nest. Query results are
+// only fetched in dump(), so recording never waits on the GPU. Names must be string literals.
+class Tracer {
+private:
+    bool enabled;
+    std::vector<TraceEvent> events;
+    std::vector<GLuint> queries;
+    size_t next;
+    size_t count;
+    int depth;
+
+    std::chrono::steady_clock::time_point cpuOrigin;
+    GLint64 gpuOrigin;
+
+    double now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - this->cpuOrigin).count();
+    }
+
+public:
+    static const size_t NONE = size_t(-1);
+
+    Tracer() : enabled(false), next(0), count(0), depth(0), gpuOrigin(0) {
+    }
+
+    ~Tracer() = default;
+
+    //Accessors
+    bool isEnabled() const {
+        return this->enabled;
+    }
+
+    //Functions
+    void enable() {
+        if (this->enabled)
+            return;
+
+        this->events.resize(TRACE_CAPACITY);
+        this->queries.resize(2 * TRACE_CAPACITY);
+        glGenQueries(GLsizei(this->queries.size()), this->queries.data());
+
+        this->cpuOrigin = std::chrono::steady_clock::now();
+        glGetInteger64v(GL_TIMESTAMP, &this->gpuOrigin);
+
+        this->enabled = true;
+    }
+
+    // Frees the query objects; must run while the context is still current
+    void release() {
+        if (!this->queries.empty())
+            glDeleteQueries(GLsizei(this->queries.size()), this->queries.data());
+
+        this->queries.clear();
+        this->events.clear();
+        this->enabled = false;
+        this->next = 0;
+        this->count = 0;
+    }
+
+    size_t begin(const char *name) {
+        if (!this->enabled)
+            return NONE;
+
+        size_t slot = this->next;
+        this->next = (this->next + 1) % TRACE_CAPACITY;
+        this->count = std::min(this->count + 1, TRACE_CAPACITY);
+
+        TraceEvent &event = this->events[slot];
+        event.name = name;
+        event.depth = this->depth++;
+        event.cpuDuration = 0.0;
+        event.cpuStart = this->now();
+
+        glQueryCounter(this->queries[2 * slot], GL_TIMESTAMP);
+
+        return slot;
+    }
+
+    void end(size_t slot) {
+        if (slot == NONE || !this->enabled)
+            return;
+
+        glQueryCounter(this->queries[2 * slot + 1], GL_TIMESTAMP);
+
+        TraceEvent &event = this->events[slot];
+        event.cpuDuration = this->now() - event.cpuStart;
+        this->depth--;
+    }
+
+    // Writes every buffered event as Chrome/Perfetto trace JSON: CPU stages on one track, GPU on another
+    bool dump(const std::string &filename) {
+        std::ofstream out(filename);
+
+        if (!out.is_open()) {
+            std::cout << "ERROR::TRACE::COULD_NOT_OPEN_FILE: " << filename << "\n";
+            return false;
+        }
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n"
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+        size_t first = (this->next + TRACE_CAPACITY - this->count) % TRACE_CAPACITY;
+
+        for (size_t n = 0; n < this->count; n++) {
+            size_t slot = (first + n) % TRACE_CAPACITY;
+            const TraceEvent &event = this->events[slot];
+
+            out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                << "\"ts\":" << event.cpuStart << ",\"dur\":" << event.cpuDuration
+                << ",\"args\":{\"depth\":" << event.depth << "}}";
+
+            GLuint available = 0;
+            glGetQueryObjectuiv(this->queries[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+
+            GLuint64 gpuBegin = 0, gpuEnd = 0;
+            glGetQueryObjectui64v(this->queries[2 * slot], GL_QUERY_RESULT, &gpuBegin);
+            glGetQueryObjectui64v(this->queries[2 * slot + 1], GL_QUERY_RESULT, &gpuEnd);
+
+            out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,"
+                << "\"ts\":" << double(GLint64(gpuBegin) - this->gpuOrigin) / 1000.0
+                << ",\"dur\":" << double(gpuEnd - gpuBegin) / 1000.0 << "}";
+        }
+
+        out << "\n]}\n";
+
+        std::cout << "Trace written to " << filename << std::endl;
+        return out.good();
+    }
+};
+
+class ScopedTrace {
+private:
+    Tracer &tracer;
+    size_t slot;
+
+public:
+    ScopedTrace(Tracer &tracer, const char *name) : tracer(tracer), slot(tracer.begin(name)) {
+    }
+
+    ~ScopedTrace() {
+        this->tracer.end(this->slot);
+    }
+
+    ScopedTrace(const ScopedTrace &) = delete;
+
+    ScopedTrace &operator=(const ScopedTrace &) = delete;
+};
+
+#endif //OPENGL_5_AXIS_TRACE_H
@@ -0,0 +1,175 @@
+#ifndef OPENGL_5_AXIS_TRANSFORM_H
+#define OPENGL_5_AXIS_TRANSFORM_H
+
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+// Slots reserved when the store first runs out of room; capacity doubles after that
+const size_t TRANSFORM_ARENA_BLOCK = 1024;
+
+// Structure-of-arrays storage for object transforms, addressed by handle. Every field lives in
+// its own contiguous array; changing a transform only writes the field and queues the slot,
+// and updateDirty() rebuilds all queued matrices in one pass. Reads never write, so once
+// updateDirty() has run on the main thread other threads may read matrices concurrently; a slot
+// still dirty is composed on the fly without being stored.
+class TransformStore {
+private:
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> matrices;
+
+    std::vector<unsigned char> dirty;
+    std::vector<unsigned> dirtyList;
+    std::vector<unsigned> freeList;
+
+    void markDirty(unsigned handle) {
+        if (!this->dirty[handle]) {
+            this->dirty[handle] = 1;
+            this->dirtyList.push_back(handle);
+        }
+    }
+
+    // Same result as translate(origin) * rotateX * rotateY * rotateZ * translate(position - origin) * scale,
+    // written out directly instead of as five 4x4 products
+    glm::mat4 compose(unsigned handle) const {
+        glm::vec3 angles = this->rotations[handle];
+        float sx = std::sin(glm::radians(angles.x)), cx = std::cos(glm::radians(angles.x));
+        float sy = std::sin(glm::radians(angles.y)), cy = std::cos(glm::radians(angles.y));
+        float sz = std::sin(glm::radians(angles.z)), cz = std::cos(glm::radians(angles.z));
+
+        glm::vec3 column0(cy * cz, sx * sy * cz + cx * sz, -cx * sy * cz + sx * sz);
+        glm::vec3 column1(-cy * sz, -sx * sy * sz + cx * cz, cx * sy * sz + sx * cz);
+        glm::vec3 column2(sy, -sx * cy, cx * cy);
+
+        glm::vec3 origin = this->origins[handle];
+        glm::vec3 offset = this->positions[handle] - origin;
+        glm::vec3 scale = this->scales[handle];
+
+        glm::mat4 matrix;
+        matrix[0] = glm::vec4(column0 * scale.x, 0.f);
+        matrix[1] = glm::vec4(column1 * scale.y, 0.f);
+        matrix[2] = glm::vec4(column2 * scale.z, 0.f);
+        matrix[3] = glm::vec4(origin + column0 * offset.x + column1 * offset.y + column2 * offset.z, 1.f);
+
+        return matrix;
+    }
+
+public:
+    TransformStore() = default;
+
+    ~TransformStore() = default;
+
+    TransformStore(const TransformStore &) = delete;
+
+    TransformStore &operator=(const TransformStore &) = delete;
+
+    //Functions
+    unsigned allocate(glm::vec3 position, glm::vec3 origin, glm::vec3 rotation, glm::vec3 scale) {
+        unsigned handle;
+
+        if (!this->freeList.empty()) {
+            handle = this->freeList.back();
+            this->freeList.pop_back();
+        } else {
+            handle = unsigned(this->positions.size());
+
+            if (this->positions.size() == this->positions.capacity()) {
+                size_t capacity = std::max(TRANSFORM_ARENA_BLOCK, 2 * this->positions.capacity());
+                this->positions.reserve(capacity);
+                this->origins.reserve(capacity);
+                this->rotations.reserve(capacity);
+                this->scales.reserve(capacity);
+                this->matrices.reserve(capacity);
+                this->dirty.reserve(capacity);
+            }
+
+            this->positions.emplace_back();
+            this->origins.emplace_back();
+            this->rotations.emplace_back();
+            this->scales.emplace_back();
+            this->matrices.emplace_back(1.f);
+            this->dirty.push_back(0);
+        }
+
+        this->positions[handle] = position;
+        this->origins[handle] = origin;
+        this->rotations[handle] = rotation;
+        this->scales[handle] = scale;
+        this->markDirty(handle);
+
+        return handle;
+    }
+
+    void release(unsigned handle) {
+        this->freeList.push_back(handle);
+    }
+
+    //Accessors
+    glm::vec3 getPosition(unsigned handle) const {
+        return this->positions[handle];
+    }
+
+    glm::vec3 getOrigin(unsigned handle) const {
+        return this->origins[handle];
+    }
+
+    glm::vec3 getRotation(unsigned handle) const {
+        return this->rotations[handle];
+    }
+
+    glm::vec3 getScale(unsigned handle) const {
+        return this->scales[handle];
+    }
+
+    glm::mat4 getMatrix(unsigned handle) const {
+        return this->dirty[handle] ? this->compose(handle) : this->matrices[handle];
+    }
+
+    //Modifiers
+    void setPosition(unsigned handle, glm::vec3 position) {
+        this->positions[handle] = position;
+        this->markDirty(handle);
+    }
+
+    void setOrigin(unsigned handle, glm::vec3 origin) {
+        this->origins[handle] = origin;
+        this->markDirty(handle);
+    }
+
+    void setRotation(unsigned handle, glm::vec3 rotation) {
+        this->rotations[handle] = rotation;
+        this->markDirty(handle);
+    }
+
+    void setScale(unsigned handle, glm::vec3 scale) {
+        this->scales[handle] = scale;
+        this->markDirty(handle);
+    }
+
+    //Rebuilds every matrix changed since the last call
+    void updateDirty() {
+        for (unsigned handle : this->dirtyList) {
+            if (this->dirty[handle]) {
+                this->matrices[handle] = this->compose(handle);
+                this->dirty[handle] = 0;
+            }
+        }
+
+        this->dirtyList.clear();
+    }
+};
+
+inline TransformStore &transformStore() {
+    static TransformStore store;
+    return store;
+}
+
+#endif //OPENGL_5_AXIS_TRANSFORM_H
@@ -0,0 +1,125 @@
+#ifndef OPENGL_5_AXIS_WORKSTEALING_H
+#define OPENGL_5_AXIS_WORKSTEALING_H
+
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Task scheduler with one deque per worker. A worker runs its newest task first (children of the
+// task it just ran, whose data is still warm) and, when its deque is empty, steals the oldest task
+// of another worker, so a few expensive jobs do not leave the other workers idle. Tasks may push
+// more tasks; work() returns once every task, including those, has run. Workers with nothing to
+// steal sleep until a task is pushed or the last task finishes, so a long single-task tail does
+// not keep the other cores busy.
+class WorkStealingScheduler {
+public:
+    typedef std::function<void(size_t worker)> Task;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::atomic<size_t> pending;
+
+    //Idle workers wait here; pushes counts every push so a wake-up between a failed steal and the
+    //wait is not missed
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    size_t pushes;
+
+    bool pop(size_t worker, Task &task) {
+        WorkerQueue &queue = *this->queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty())
+            return false;
+
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t thief, Task &task) {
+        for (size_t offset = 1; offset < this->queues.size(); offset++) {
+            WorkerQueue &queue = *this->queues[(thief + offset) % this->queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (queue.tasks.empty())
+                continue;
+
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+
+        return false;
+    }
+
+public:
+    explicit WorkStealingScheduler(size_t workers) : pending(0), pushes(0) {
+        for (size_t i = 0; i < workers; i++)
+            this->queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    //Accessors
+    size_t size() const {
+        return this->queues.size();
+    }
+
+    //Functions
+
+    // Queues a task on the given worker's deque; safe to call from inside a running task
+    void push(size_t worker, Task task) {
+        this->pending++;
+
+        {
+            WorkerQueue &queue = *this->queues[worker];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->idleMutex);
+            this->pushes++;
+        }
+        this->idle.notify_one();
+    }
+
+    // Runs tasks as the given worker until none are left anywhere. Called by every worker thread;
+    // a task's children are pushed before it counts as done, so pending only reaches 0 at the end.
+    void work(size_t worker) {
+        Task task;
+
+        while (this->pending.load() > 0) {
+            size_t seen;
+            {
+                std::lock_guard<std::mutex> lock(this->idleMutex);
+                seen = this->pushes;
+            }
+
+            if (this->pop(worker, task) || this->steal(worker, task)) {
+                task(worker);
+                task = nullptr;
+
+                if (--this->pending == 0) {
+                    std::lock_guard<std::mutex> lock(this->idleMutex);
+                    this->idle.notify_all();
+                }
+            } else {
+                //Every queue was empty after seen pushes; sleep until another push or the end
+                std::unique_lock<std::mutex> lock(this->idleMutex);
+                this->idle.wait(lock, [&] { return this->pushes != seen || this->pending.load() == 0; });
+            }
+        }
+    }
+};
+
+#endif //OPENGL_5_AXIS_WORKSTEALING_H
@@ -0,0 +1,187 @@
+#ifndef OPENGL_5_AXIS_ZMAP_H
+#define OPENGL_5_AXIS_ZMAP_H
+
+
+#include <vector>
+#include <map>
+#include <thread>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "cutter.h"
+
+// Fewest rows per thread when cutting; smaller maps are cut on the calling thread
+const int ZMAP_MIN_ROWS_PER_THREAD = 32;
+
+// Cutter heights relative to its origin, sampled on the Z-map lattice around the axis.
+// Cells outside the silhouette are +infinity so they never lower the stock.
+struct ZMapFootprint {
+    int radius;
+    std::vector<float> heights;
+};
+
+// Stock as a Z-map (one vertical dexel per cell): the top height of material at every cell
+// centre of a regular grid in world xy. Cutting lowers each cell to the bottom of the tool.
+class ZMap {
+private:
+    glm::vec2 origin;
+    float cellSize;
+    int width;
+    int height;
+    std::vector<float> heights;
+
+    std::map<Cutter, ZMapFootprint> footprints;
+
+    const ZMapFootprint &footprint(const Cutter &cutter) {
+        auto cached = this->footprints.find(cutter);
+        if (cached != this->footprints.end())
+            return cached->second;
+
+        CutterProfile profile(cutter);
+        ZMapFootprint footprint{};
+        footprint.radius = int(std::ceil(profile.getSilhouetteRadius() / this->cellSize));
+
+        int side = 2 * footprint.radius + 1;
+        footprint.heights.resize(size_t(side) * side);
+
+        for (int dy = -footprint.radius; dy <= footprint.radius; dy++) {
+            for (int dx = -footprint.radius; dx <= footprint.radius; dx++) {
+                float z;
+                float rho = this->cellSize * std::sqrt(float(dx * dx + dy * dy));
+
+                footprint.heights[size_t(dy + footprint.radius) * side + dx + footprint.radius] =
+                        profile.heightAt(rho, z) ? z : std::numeric_limits<float>::infinity();
+            }
+        }
+
+        return this->footprints.emplace(cutter, std::move(footprint)).first->second;
+    }
+
+public:
+    // A flat block of the given top height
+    ZMap(glm::vec2 origin, float cellSize, int width, int height, float top)
+            : origin(origin), cellSize(cellSize), width(width), height(height),
+              heights(size_t(width) * height, top) {
+    }
+
+    // From a view-distance map of an ortho view looking down -z (rows bottom first, as read
+    // back), one cell per pixel; the pixels must be square, so the window is given by its left,
+    // right and bottom edges. Pixels not covered by the workpiece body get the lowest covered height.
+    ZMap(const GLfloat *distance, const GLubyte *mask, float left, float right, float bottom,
+         int width, int height, float cameraZ, float allowance)
+            : origin(left, bottom), cellSize((right - left) / float(width)), width(width), height(height),
+              heights(size_t(width) * height) {
+        float lowest = std::numeric_limits<float>::max();
+
+        for (size_t i = 0; i < this->heights.size(); i++) {
+            if (mask[i] == BODY_WORKPIECE) {
+                this->heights[i] = cameraZ - distance[i] + allowance;
+                lowest = std::min(lowest, this->heights[i]);
+            }
+        }
+
+        if (lowest == std::numeric_limits<float>::max())
+            lowest = cameraZ - DEPTH_BACKGROUND;
+
+        for (size_t i = 0; i < this->heights.size(); i++)
+            if (mask[i] != BODY_WORKPIECE)
+                this->heights[i] = lowest;
+    }
+
+    ~ZMap() = default;
+
+    //Accessors
+    int getWidth() const {
+        return this->width;
+    }
+
+    int getHeight() const {
+        return this->height;
+    }
+
+    float getCellSize() const {
+        return this->cellSize;
+    }
+
+    const float *getHeights() const {
+        return this->heights.data();
+    }
+
+    glm::vec3 cellPoint(int column, int row) const {
+        return glm::vec3(this->origin.x + (float(column) + 0.5f) * this->cellSize,
+                         this->origin.y + (float(row) + 0.5f) * this->cellSize,
+                         this->heights[size_t(row) * this->width + column]);
+    }
+
+    //Functions
+
+    // Removes the material under every tool pose (cutter origin in world space, axis along +z).
+    // Poses are snapped to the nearest cell centre so a cached footprint can be used, which keeps
+    // the inner loop a plain min over contiguous floats. Removal is a min, so pose order does not
+    // matter: the rows are split into bands and every thread applies all poses to its own band.
+    void cut(const Cutter &cutter, const std::vector<glm::vec3> &poses) {
+        const ZMapFootprint &footprint = this->footprint(cutter);
+        const int radius = footprint.radius;
+        const int side = 2 * radius + 1;
+
+        int threads = std::max(1, std::min(int(std::thread::hardware_concurrency()),
+                                           this->height / ZMAP_MIN_ROWS_PER_THREAD));
+        int band = (this->height + threads - 1) / threads;
+
+        auto cutBand = [&](int rowFirst, int rowLast) {
+            for (auto &pose : poses) {
+                int column = int(std::floor((pose.x - this->origin.x) / this->cellSize));
+                int row = int(std::floor((pose.y - this->origin.y) / this->cellSize));
+
+                int r0 = std::max(row - radius, rowFirst), r1 = std::min(row + radius + 1, rowLast);
+                int c0 = std::max(column - radius, 0), c1 = std::min(column + radius + 1, this->width);
+                if (r0 >= r1 || c0 >= c1)
+                    continue;
+
+                for (int r = r0; r < r1; r++) {
+                    float *stock = this->heights.data() + size_t(r) * this->width + c0;
+                    const float *tool = footprint.heights.data() + size_t(r - row + radius) * side + (c0 - column + radius);
+                    const float z = pose.z;
+
+                    for (int k = 0; k < c1 - c0; k++)
+                        stock[k] = std::min(stock[k], z + tool[k]);
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int t = 1; t < threads; t++)
+            workers.emplace_back(cutBand, std::min(t * band, this->height), std::min((t + 1) * band, this->height));
+
+        cutBand(0, std::min(band, this->height));
+
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    // Splits every linear move so consecutive poses are at most step apart
+    static std::vector<glm::vec3> interpolatePath(const std::vector<glm::vec3> &path, float step) {
+        std::vector<glm::vec3> poses;
+
+        for (size_t i = 0; i < path.size(); i++) {
+            if (i == 0) {
+                poses.push_back(path[i]);
+                continue;
+            }
+
+            int steps = std::max(1, int(std::ceil(glm::length(path[i] - path[i - 1]) / step)));
+            for (int k = 1; k <= steps; k++)
+                poses.push_back(path[i - 1] + (path[i] - path[i - 1]) * (float(k) / float(steps)));
+        }
+
+        return poses;
+    }
+};
+
+#endif //OPENGL_5_AXIS_ZMAP_H
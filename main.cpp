@@ -1,16 +1,190 @@
 #include "game.h"
 
 #include <chrono>
+#include <cstring>
 
-int main() {
+//--cutter torus | ball <d> <h> | flat <d> <h> | bull <d> <r> <h> | apt <d> <r> <e> <f> <alpha> <beta> <h>
+static bool parseCutter(int argc, char **argv, int &i, Cutter &cutter) {
+    if (i + 1 >= argc)
+        return false;
+
+    const char *type = argv[++i];
+    float v[7];
+
+    auto values = [&](int count) {
+        if (i + count >= argc)
+            return false;
+        for (int k = 0; k < count; k++)
+            v[k] = std::stof(argv[++i]);
+        return true;
+    };
+
+    if (strcmp(type, "torus") == 0)
+        cutter = Cutter::torus();
+    else if (strcmp(type, "ball") == 0 && values(2))
+        cutter = Cutter::ball(v[0], v[1]);
+    else if (strcmp(type, "flat") == 0 && values(2))
+        cutter = Cutter::flat(v[0], v[1]);
+    else if (strcmp(type, "bull") == 0 && values(3))
+        cutter = Cutter::bullNose(v[0], v[1], v[2]);
+    else if (strcmp(type, "apt") == 0 && values(7))
+        cutter = Cutter::apt(v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+    else
+        return false;
+
+    return true;
+}
+
+//Names of the two bodies meeting at a contact pixel
+static std::string contactBodies(const Pixel &p) {
+    static const char *toolBodies[] = {"none", "cutter", "shank", "holder"};
+
+    std::string tool = p.toolBody < 4 ? toolBodies[p.toolBody] : "holder " + std::to_string(p.toolBody - BODY_HOLDER);
+    std::string obstacle = p.obstacleBody == BODY_WORKPIECE ? "workpiece" :
+                           p.obstacleBody == 0 ? "none" : "fixture " + std::to_string(p.obstacleBody - BODY_FIXTURE);
+
+    return tool + " / " + obstacle;
+}
+
+int main(int argc, char **argv) {
+    auto launch = std::chrono::high_resolution_clock::now();
 
     Game game("Learnin' Opengl",
               480, 480,
               4, 4,
               true);
 
-    for (int i = 0; i < 20; i++)
-        game.initialRender();
+    const char *traceFile = nullptr;
+
+    //--stock block <top> | workpiece <allowance>
+    const char *stockType = nullptr;
+    float stockHeight = 0.f;
+    const char *toolpathFile = nullptr;
+
+    //--export-stl <file>: the workpiece as binary STL, after any material removal
+    const char *exportStlFile = nullptr;
+
+    //--sweep <x0> <y0> <z0> <x1> <y1> <z1>: tool origins of a linear move to query as one swept volume
+    bool sweep = false;
+    glm::vec3 sweepFrom(0.f), sweepTo(0.f);
+
+    //--poses <file> <workers>: tool origins to evaluate in parallel, one "x y z" per line
+    const char *posesFile = nullptr;
+    size_t poseWorkers = 0;
+
+    //--pose-refine <levels> <below>: extra zoomed passes for poses whose clearance is below the limit
+    int poseRefinements = 0;
+    float poseRefineBelow = std::numeric_limits<float>::max();
+
+    //--tiles <x> <y>: contact query at x * y times the window resolution, rendered tile by tile
+    int tilesX = 0, tilesY = 0;
+
+    //Options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--export-pfm") == 0 && i + 1 < argc)
+            game.setMapExport(EXPORT_PFM, argv[++i]);
+        else if (strcmp(argv[i], "--export-npy") == 0 && i + 1 < argc)
+            game.setMapExport(EXPORT_NPY, argv[++i]);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            traceFile = argv[++i];
+        else if (strcmp(argv[i], "--cutter") == 0) {
+            Cutter cutter{};
+            if (parseCutter(argc, argv, i, cutter))
+                game.setCutter(cutter);
+            else
+                std::cout << "ERROR::MAIN::INVALID_CUTTER" << "\n";
+        }
+        else if (strcmp(argv[i], "--contacts") == 0 && i + 2 < argc) {
+            float tolerance = std::stof(argv[++i]);
+            game.setContactTolerance(tolerance, std::stoul(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--readback-tolerance") == 0 && i + 1 < argc)
+            //Largest rounding error allowed for half-float distance readback
+            game.setReadbackTolerance(std::stof(argv[++i]));
+        else if (strcmp(argv[i], "--workpiece") == 0 && i + 1 < argc)
+            //NURBS patches replacing the built-in Bezier workpiece, see loadNurbsPatches
+            game.loadWorkpiece(argv[++i]);
+        else if (strcmp(argv[i], "--stock") == 0 && i + 2 < argc) {
+            stockType = argv[++i];
+            stockHeight = std::stof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--toolpath") == 0 && i + 1 < argc)
+            toolpathFile = argv[++i];
+        else if (strcmp(argv[i], "--holder") == 0 && i + 4 < argc) {
+            //--holder <shank diameter> <shank length> <holder diameter> <holder length>
+            float v[4];
+            for (float &value : v)
+                value = std::stof(argv[++i]);
+            game.setToolHolder(v[0], v[1], v[2], v[3]);
+        }
+        else if (strcmp(argv[i], "--fixture") == 0 && i + 6 < argc) {
+            //--fixture <x0> <y0> <z0> <x1> <y1> <z1>: box corners in world space, may be repeated
+            glm::vec3 corners[2];
+            for (auto &corner : corners)
+                for (int k = 0; k < 3; k++)
+                    corner[k] = std::stof(argv[++i]);
+            game.addFixture(glm::min(corners[0], corners[1]), glm::max(corners[0], corners[1]));
+        }
+        else if (strcmp(argv[i], "--fixture-stl") == 0 && i + 1 < argc)
+            //Binary STL fixture in world space, may be repeated
+            game.addFixtureMesh(argv[++i]);
+        else if (strcmp(argv[i], "--export-stl") == 0 && i + 1 < argc)
+            exportStlFile = argv[++i];
+        else if (strcmp(argv[i], "--poses") == 0 && i + 2 < argc) {
+            posesFile = argv[++i];
+            poseWorkers = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tiles") == 0 && i + 2 < argc) {
+            tilesX = std::stoi(argv[++i]);
+            tilesY = std::stoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pose-refine") == 0 && i + 2 < argc) {
+            poseRefinements = std::stoi(argv[++i]);
+            poseRefineBelow = std::stof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sweep") == 0 && i + 6 < argc) {
+            for (int k = 0; k < 3; k++)
+                sweepFrom[k] = std::stof(argv[++i]);
+            for (int k = 0; k < 3; k++)
+                sweepTo[k] = std::stof(argv[++i]);
+            sweep = true;
+        }
+        else
+            std::cout << "Unknown option " << argv[i] << std::endl;
+    }
+
+    if (stockType) {
+        if (strcmp(stockType, "block") == 0 || strcmp(stockType, "workpiece") == 0)
+            game.createStock(strcmp(stockType, "workpiece") == 0, stockHeight);
+        else
+            std::cout << "ERROR::MAIN::INVALID_STOCK" << "\n";
+    }
+
+    if (toolpathFile) {
+        std::vector<glm::vec3> toolpath = loadToolpath(toolpathFile);
+
+        auto cutStart = std::chrono::high_resolution_clock::now();
+        game.cutStock(toolpath);
+        auto cutStop = std::chrono::high_resolution_clock::now();
+
+        std::cout << "Material removal: "
+                  << duration_cast<std::chrono::milliseconds>(cutStop - cutStart).count() << " ms" << std::endl;
+    }
+
+    if (exportStlFile)
+        game.exportWorkpiece(exportStlFile);
+
+    game.warmUp();
+
+    std::cout << "Startup: "
+              << duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - launch).count()
+              << " ms" << std::endl;
+
+    if (traceFile)
+        game.getTracer().enable();
+
+    Tracer &tracer = game.getTracer();
+    size_t contactQuery = tracer.begin("contact query");
 
     auto start = std::chrono::high_resolution_clock::now();
     std::cout << "Calculating Depth map..." << std::endl;
@@ -26,19 +200,73 @@ int main() {
     p = game.calculateNearestPixel();
     std::cout << "Torus touched at " << p->x_cord << ", " << p->y_cord << std::endl;
     std::cout << "Z movement required for first point of contact :  " << p->depth << std::endl;
+    std::cout << "First contact between " << contactBodies(*p) << std::endl;
+
+    std::vector<Pixel> contacts = game.getContactPoints();
+    if (contacts.size() > 1) {
+        std::cout << contacts.size() << " contact regions within tolerance:" << std::endl;
+        for (auto &contact : contacts)
+            std::cout << "\t" << contact.x_cord << ", " << contact.y_cord << " : " << contact.depth
+                      << " (" << contactBodies(contact) << ")" << std::endl;
+    }
+
+    if (sweep) {
+        Pixel *swept = game.calculateSweptNearestPixel(sweepFrom, sweepTo);
+        std::cout << "Swept move touched at " << swept->x_cord << ", " << swept->y_cord << std::endl;
+        std::cout << "Z movement required for the move to make contact :  " << swept->depth << std::endl;
+        std::cout << "First contact between " << contactBodies(*swept) << std::endl;
+        delete swept;
+    }
+
+    if (tilesX > 0 && tilesY > 0) {
+        auto tiledStart = std::chrono::high_resolution_clock::now();
+        std::vector<Pixel> tiled = game.calculateTiledContacts(tilesX, tilesY);
+        auto tiledStop = std::chrono::high_resolution_clock::now();
+
+        std::cout << tilesX << "x" << tilesY << " tiles in "
+                  << duration_cast<std::chrono::milliseconds>(tiledStop - tiledStart).count() << " ms" << std::endl;
+        if (!tiled.empty())
+            std::cout << "Tiled contact at " << tiled.front().x_cord << ", " << tiled.front().y_cord << " : "
+                      << tiled.front().depth << " (" << contactBodies(tiled.front()) << "), "
+                      << tiled.size() << " regions" << std::endl;
+    }
+
+    if (posesFile) {
+        std::vector<glm::vec3> poses = loadToolpath(posesFile);
+        size_t startedWorkers = game.startPoseWorkers(poseWorkers);
+
+        auto posesStart = std::chrono::high_resolution_clock::now();
+        std::vector<Pixel> results = game.evaluatePoses(poses, poseRefinements, poseRefineBelow);
+        auto posesStop = std::chrono::high_resolution_clock::now();
+
+        auto nearest = std::min_element(results.begin(), results.end(),
+                                        [](const Pixel &a, const Pixel &b) { return a.depth < b.depth; });
+
+        if (results.empty())
+            std::cout << "No poses evaluated" << std::endl;
+        else
+            std::cout << poses.size() << " poses on " << startedWorkers << " workers in "
+                      << duration_cast<std::chrono::milliseconds>(posesStop - posesStart).count() << " ms"
+                      << std::endl;
+        if (nearest != results.end())
+            std::cout << "Smallest clearance " << nearest->depth << " at pose " << nearest - results.begin()
+                      << " (" << contactBodies(*nearest) << ")" << std::endl;
+    }
 
     float zoomTolerance = 0.1;
 
+    size_t refinement = tracer.begin("refinement");
+
     game.setOrthoMatrixBounds(p->x_cord-zoomTolerance, p->x_cord+zoomTolerance, p->y_cord-zoomTolerance, p->y_cord+zoomTolerance);
     game.swapTorusAndBezier();
 
     game.recalculateDepthMap();
     game.swapTorusAndBezier();
 
-    game.setNewScaleFactor(zoomTolerance);
-
     Pixel *newP = game.reCalculateNearestPixel();
 
+    tracer.end(refinement);
+
     std::cout << "[NEW] Torus touched at " << newP->x_cord << ", " << newP->y_cord << std::endl;
     std::cout << "[NEW] Z movement required for first point of contact :  " << newP->depth << std::endl;
 
@@ -46,12 +274,20 @@ int main() {
     auto duration = duration_cast<std::chrono::microseconds>(stop - start);
     std::cout << "Time taken by function: "
               << duration.count() << " microseconds" << std::endl;
+
+    tracer.end(contactQuery);
+
+    if (traceFile)
+        tracer.dump(traceFile);
     //MAIN LOOP
     while (!game.getWindowShouldClose()) {
 
-        //UPDATE INPUT ---
+        //UPDATE INPUT --- (blocks until an event arrives while idle)
         game.update();
-        game.render();
+
+        //Redraw only when the camera, models or render mode changed
+        if (game.needsRender())
+            game.render();
     }
 
     return 0;
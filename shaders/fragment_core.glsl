@@ -1,5 +1,9 @@
 #version 440
 
+//Feature flags, defined per permutation by Shader:
+//  LIGHTING        ambient and diffuse shading; without it the vertex colour is written flat
+//  CONTACT_OUTPUT  view distance and body ID attachments read back by the contact passes
+
 struct Material
 {
     vec3 ambient;
@@ -9,19 +13,29 @@ struct Material
     sampler2D specularTex;
 };
 
-in vec3 vs_position;
 in vec3 vs_color;
-in vec2 vs_texcoord;
+#ifdef LIGHTING
+in vec3 vs_position;
 in vec3 vs_normal;
-
-out vec4 fs_color;
+#endif
+#ifdef CONTACT_OUTPUT
+in float vs_distance;
+#endif
+
+layout (location = 0) out vec4 fs_color;
+#ifdef CONTACT_OUTPUT
+//Contact data: distance from the camera along the view axis, and the ID of the body drawn (0 = none)
+layout (location = 1) out float fs_distance;
+layout (location = 2) out uint fs_coverage;
+#endif
 
 //Uniforms
 uniform Material material;
 uniform vec3 lightPos0;
-uniform vec3 cameraPos;
+uniform uint bodyId;
 
 //Functions
+#ifdef LIGHTING
 vec3 calculateAmbient(Material material)
 {
     return material.ambient;
@@ -35,46 +49,26 @@ vec3 calculateDiffuse(Material material, vec3 vs_position, vec3 vs_normal, vec3
 
     return diffuseFinal;
 }
-
-vec3 calculateSpecular(Material material, vec3 vs_position, vec3 vs_normal, vec3 lightPos0, vec3 cameraPos)
-{
-    vec3 lightToPosDirVec=normalize(vs_position-lightPos0);
-    vec3 reflectDirVec=normalize(reflect(lightToPosDirVec, normalize(vs_normal)));
-    vec3 posToViewDirVec=normalize(cameraPos-vs_position);
-    float specularConstant=pow(max(dot(posToViewDirVec, reflectDirVec), 0), 35);
-    vec3 specularFinal=material.specular*specularConstant*texture(material.specularTex, vs_texcoord).rgb;
-
-    return specularFinal;
-}
-
-float near=.1;
-float far=100.;
-
-float LinearizeDepth(float depth)
-{
-    float z=depth*2.-1.;// back to NDC
-    return (2.*near*far)/(far+near-z*(far-near));
-}
+#endif
 
 void main()
 {
-    //fs_color = vec4(vs_color, 1.f);
-    //fs_color = texture(texture0, vs_texcoord) * texture(texture1, vs_texcoord) * vec4(vs_color, 1.f);
-
+#ifdef LIGHTING
     //Ambient light
     vec3 ambientFinal=calculateAmbient(material);
 
     //Diffuse light
     vec3 diffuseFinal=calculateDiffuse(material, vs_position, vs_normal, lightPos0);
 
-    //Specular light
-    vec3 specularFinal=calculateSpecular(material, vs_position, vs_normal, lightPos0, cameraPos);
-
-    //Attenuation
-
     //Final light
     fs_color= vec4(vs_color, 1.f)*
     (vec4(ambientFinal, 1.f)+vec4(diffuseFinal, 1.f));
-    // float depth = LinearizeDepth(gl_FragCoord.z) / far;
-    // fs_color = vec4(depth, 0, 0, 1.0);
+#else
+    fs_color=vec4(vs_color, 1.f);
+#endif
+
+#ifdef CONTACT_OUTPUT
+    fs_distance=vs_distance;
+    fs_coverage=bodyId;
+#endif
 }
@@ -1,14 +1,22 @@
 #version 440
 
+//Feature flags, defined per permutation by Shader:
+//  LIGHTING        world position and normal for the lit display pass
+//  CONTACT_OUTPUT  view distance for the contact attachments
+
 layout (location = 0) in vec3 vertex_position;
 layout (location = 1) in vec3 vertex_color;
 layout (location = 2) in vec2 vertex_texcoord;
 layout (location = 3) in vec3 vertex_normal;
 
-out vec3 vs_position;
 out vec3 vs_color;
-out vec2 vs_texcoord;
+#ifdef LIGHTING
+out vec3 vs_position;
 out vec3 vs_normal;
+#endif
+#ifdef CONTACT_OUTPUT
+out float vs_distance;
+#endif
 
 uniform mat4 ModelMatrix;
 uniform mat4 ViewMatrix;
@@ -16,10 +24,17 @@ uniform mat4 ProjectionMatrix;
 
 void main()
 {
-    vs_position = vec4(ModelMatrix * vec4(vertex_position, 1.f)).xyz;
+    vec4 worldPosition = ModelMatrix * vec4(vertex_position, 1.f);
+    vec4 viewPosition = ViewMatrix * worldPosition;
+
     vs_color = vertex_color;
-    vs_texcoord = vec2(vertex_texcoord.x, vertex_texcoord.y * -1.f);
+#ifdef LIGHTING
+    vs_position = worldPosition.xyz;
     vs_normal = mat3(ModelMatrix) * vertex_normal;
+#endif
+#ifdef CONTACT_OUTPUT
+    vs_distance = -viewPosition.z;
+#endif
 
-    gl_Position = ProjectionMatrix * ViewMatrix * ModelMatrix * vec4(vertex_position, 1.f);
-}
\ No newline at end of file
+    gl_Position = ProjectionMatrix * viewPosition;
+}